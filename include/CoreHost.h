@@ -0,0 +1,268 @@
+/**
+ * @file CoreHost.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Runs a libretro core in a child process and talks to it over shared memory.
+ */
+
+class CoreHost;
+struct CoreHostShared;
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+#include "libretro.h"
+
+#include "Frame.h"
+#include "Logging.hpp"
+#include "RetroPad.h"
+
+/**
+ * @enum kCoreHostCommand
+ *
+ * What the child process is asked to do
+ */
+enum class kCoreHostCommand : std::uint32_t {
+    /** Load the core and the game **/
+            Init,
+    /** retro_run once **/
+            Run,
+    /** retro_serialize_size **/
+            StateSize,
+    /** retro_serialize into the state area **/
+            SaveState,
+    /** retro_unserialize from the state area **/
+            LoadState,
+    /** Unload and exit **/
+            Quit,
+};
+
+/**
+ * @struct CoreHostShared
+ *
+ * Start of the memory shared between the server and a core host. Followed by kFrameSlots frames of kMaxFrameBytes
+ * each and then kMaxStateBytes for save states; the pages are only backed once they're touched.
+ *
+ * The server writes a request and bumps request, the child does the work, fills in the results and sets response
+ * to the same value. Both sides sleep on these with a futex, everything else is plain memory handed over by the
+ * release/acquire on them, so it's only ever touched by one side at a time.
+ */
+struct CoreHostShared {
+    static constexpr std::uint32_t kMagic = 0x4C504348; // LPCH
+    static constexpr std::size_t kPathSize = 4096;
+    static constexpr std::size_t kFrameSlots = 2;
+    static constexpr std::size_t kMaxFrameBytes = 4 * 1024 * 1024;
+    static constexpr std::size_t kMaxStateBytes = 64 * 1024 * 1024;
+
+    std::uint32_t magic;
+
+    /**
+     * Set up by the server before starting the child
+     */
+    char corePath[kPathSize];
+    char romPath[kPathSize];
+    char extractDirectory[kPathSize];
+    char systemDirectory[kPathSize];
+    char saveDirectory[kPathSize];
+    char username[256];
+
+    std::atomic<std::uint32_t> request;
+    std::atomic<std::uint32_t> response;
+
+    /**
+     * Request
+     */
+    kCoreHostCommand command;
+
+    /**
+     * Frame time to give the core's frame time callback, < 0 for its reference time
+     */
+    std::int64_t frameTime;
+
+    /**
+     * Answer to GET_AUDIO_VIDEO_ENABLE
+     */
+    std::int32_t audioVideoEnable;
+
+    /**
+     * Joypad state: bit n is button n, then both sticks as [index][axis]
+     */
+    std::uint16_t buttons;
+    std::int16_t analog[2][2];
+
+    /**
+     * Size of the state in the state area, both ways
+     */
+    std::uint64_t stateSize;
+
+    /**
+     * Whether the request succeeded
+     */
+    std::int32_t result;
+
+    /**
+     * Latest frame the core produced, in frameSlot. frameSequence goes up by one for every new frame.
+     */
+    std::uint64_t frameSequence;
+    std::uint32_t frameSlot;
+    std::uint32_t frameWidth, frameHeight, framePitch;
+    retro_pixel_format frameFormat;
+
+    /**
+     * Timing and geometry, avinfoSequence goes up whenever the core changes them
+     */
+    std::uint64_t avinfoSequence;
+    retro_system_av_info avinfo;
+
+    /**
+     * Start of a frame slot, counted from the start of the shared memory
+     */
+    static constexpr std::size_t FrameOffset(std::size_t slot) {
+        return ((sizeof(CoreHostShared) + 4095) & ~std::size_t(4095)) + slot * kMaxFrameBytes;
+    }
+
+    /**
+     * Start of the state area
+     */
+    static constexpr std::size_t StateOffset() { return FrameOffset(kFrameSlots); }
+
+    /**
+     * Size of the whole shared memory
+     */
+    static constexpr std::size_t TotalSize() { return StateOffset() + kMaxStateBytes; }
+};
+
+/**
+ * @class CoreHost
+ *
+ * Server side of an isolated core. Every call blocks until the child answers. A child that dies, or doesn't
+ * answer within the stall timeout, is killed; the call fails and Alive returns false until it's started again, which
+ * is up to the caller since it knows which state to bring it back to.
+ *
+ * The child is this same executable started with --core-host, see CoreHost::ChildMain.
+ *
+ * @note Not thread-safe, used by the emulator's own thread
+ */
+class CoreHost {
+  public:
+    /**
+     * @struct Options
+     *
+     * What the child needs to know to start the core
+     */
+    struct Options {
+        std::string corePath;
+        std::string romPath;
+        std::string extractDirectory;
+        std::string systemDirectory;
+        std::string saveDirectory;
+        std::string username;
+
+        /**
+         * How long a call may take before the child counts as stalled. Loading the game gets at least 30 seconds.
+         */
+        std::chrono::milliseconds stallTimeout{5000};
+    };
+
+    CoreHost() = default;
+    CoreHost(const CoreHost &) = delete;
+    CoreHost &operator=(const CoreHost &) = delete;
+    ~CoreHost();
+
+    /**
+     * Starts (or restarts) the child and loads the core and game in it
+     *
+     * @param options What to load
+     * @param logger Where to report failures and crashes of the child
+     * @param name Prefix for log messages, usually the emulator id
+     *
+     * @return false if the child couldn't be started or failed to load the game
+     */
+    bool Start(const Options &options, Logger &logger, const std::string &name);
+
+    /**
+     * Asks the child to exit, kills it if it doesn't
+     */
+    void Stop();
+
+    /**
+     * Whether there's a child that's answering
+     */
+    bool Alive() const { return m_Pid > 0; }
+
+    /**
+     * Runs one frame
+     *
+     * @param joypad Input for the frame
+     * @param audioVideoEnable Answer to GET_AUDIO_VIDEO_ENABLE during the frame
+     * @param frameTime For the frame time callback, < 0 for the core's reference time
+     */
+    bool Run(RetroPad &joypad, int audioVideoEnable, std::int64_t frameTime);
+
+    std::size_t SaveStateSize();
+    bool SaveState(void *data, std::size_t size);
+    bool LoadState(const void *data, std::size_t size);
+
+    /**
+     * The core's current timing and geometry
+     */
+    void GetAudioVideoInfo(retro_system_av_info &info) const;
+
+    /**
+     * Gets the frame produced since the last call, if there is one. It stays valid until the next Run.
+     */
+    bool TakeFrame(Frame &frame);
+
+    /**
+     * Gets the timing and geometry if the core changed them since the last call
+     */
+    bool TakeAudioVideoInfo(retro_system_av_info &info);
+
+    /**
+     * Entry point of the child process
+     *
+     * @param fd The shared memory, inherited from the server
+     *
+     * @return Exit code
+     */
+    static int ChildMain(int fd);
+
+  private:
+    /**
+     * Sends the request in the shared memory and waits for the answer. Kills the child if it doesn't come.
+     */
+    bool call(kCoreHostCommand command, std::chrono::milliseconds timeout);
+
+    /**
+     * Kills and reaps the child
+     */
+    void kill();
+
+    /**
+     * Sleeps while word still holds expected, for at most timeout. Works across processes.
+     */
+    static void futexWait(std::atomic<std::uint32_t> &word, std::uint32_t expected, std::chrono::milliseconds timeout);
+
+    /**
+     * Wakes whoever sleeps on word
+     */
+    static void futexWake(std::atomic<std::uint32_t> &word);
+
+    Options m_Options;
+    Logger *m_Logger{nullptr};
+    std::string m_Name;
+
+    int m_Fd{-1};
+    CoreHostShared *m_Shared{nullptr};
+    pid_t m_Pid{-1};
+
+    std::uint64_t m_LastFrame{0}, m_LastAvinfo{0};
+};
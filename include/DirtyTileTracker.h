@@ -0,0 +1,101 @@
+/**
+ * @file DirtyTileTracker.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Finds which 16x16 tiles of a frame changed since the previous one.
+ */
+
+class DirtyTileTracker;
+struct TileRect;
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "libretro.h"
+
+#include "Frame.h"
+#include "PixelConversion.h"
+
+/**
+ * @struct TileRect
+ *
+ * A changed area of a frame, in pixels. Always made of whole tiles (clipped to the frame edge).
+ */
+struct TileRect {
+    std::uint32_t x{0};
+    std::uint32_t y{0};
+    std::uint32_t width{0};
+    std::uint32_t height{0};
+};
+
+/**
+ * @class DirtyTileTracker
+ *
+ * Keeps a copy of the last frame it saw (in the core's pixel format) and compares new frames against it tile by
+ * tile. Changed tiles are merged into rectangles so they can each be encoded as one jpeg.
+ *
+ * @note Not thread-safe, owned by whoever sends the frames of one emulator.
+ */
+class DirtyTileTracker {
+  public:
+    /**
+     * Width and height of a tile in pixels
+     */
+    static constexpr std::uint32_t kTileSize = 16;
+
+    /**
+     * Compares frame against the retained copy and then retains frame.
+     *
+     * @param frame The new frame
+     *
+     * @return false if there was nothing to compare against (first frame, or the size/format changed), in which
+     * case every tile is marked dirty and a full frame should be sent.
+     */
+    bool Update(const Frame &frame);
+
+    /**
+     * Forget the retained frame, the next Update will return false
+     */
+    void Reset();
+
+    /**
+     * Changed areas found by the last Update, merged into rectangles
+     */
+    std::vector<TileRect> DirtyRects() const;
+
+    /**
+     * Fraction (0 to 1) of the tiles that changed in the last Update
+     */
+    double DirtyFraction() const;
+
+  private:
+    /**
+     * Copy of the previous frame, tightly packed
+     */
+    std::vector<std::uint8_t> m_previous;
+
+    /**
+     * One entry per tile, row major. Nonzero if the tile changed.
+     */
+    std::vector<std::uint8_t> m_dirty;
+
+    /**
+     * Number of nonzero entries in m_dirty
+     */
+    std::size_t m_dirtyCount{0};
+
+    /**
+     * Size and format of the retained frame
+     */
+    std::uint32_t m_width{0}, m_height{0};
+    retro_pixel_format m_format{RETRO_PIXEL_FORMAT_UNKNOWN};
+
+    /**
+     * Size of the tile grid
+     */
+    std::uint32_t m_tilesX{0}, m_tilesY{0};
+};
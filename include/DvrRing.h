@@ -0,0 +1,117 @@
+/**
+ * @file DvrRing.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Fixed-size in-memory ring of the last few seconds of encoded frames, for rewinding the live stream.
+ */
+
+class DvrRing;
+struct DvrEntry;
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/**
+ * @struct DvrEntry
+ *
+ * One frame in the ring
+ */
+struct DvrEntry {
+    /**
+     * Counts up by one per appended frame
+     */
+    std::uint64_t sequence{0};
+
+    /**
+     * When the frame was shown, in ms on the steady clock
+     */
+    std::uint64_t time{0};
+
+    /**
+     * Where the frame is in the ring and how big it is
+     */
+    std::size_t offset{0}, size{0};
+};
+
+/**
+ * @class DvrRing
+ *
+ * Encoded frames back to back in one preallocated buffer, oldest overwritten first, with an index of when each one
+ * was shown. Frames are only added when the picture changes, so the frame on screen at some time is the last one
+ * added at or before it. A frame never wraps around the end of the buffer; the leftover space at the end is skipped.
+ *
+ * @note Not thread-safe, owned by whoever sends the frames of one emulator
+ */
+class DvrRing {
+  public:
+    /**
+     * Sets the size of the ring and drops everything in it. A capacity of 0 turns the ring off.
+     *
+     * @param capacity Bytes of frame data to keep
+     * @param maxAge Frames older than this (in ms) are dropped even if there's room for them
+     */
+    void Configure(std::size_t capacity, std::uint64_t maxAge);
+
+    /**
+     * Whether or not the ring is turned on
+     */
+    bool Enabled() const { return !m_buffer.empty(); }
+
+    /**
+     * Capacity and max age given to Configure
+     */
+    std::size_t Capacity() const { return m_buffer.size(); }
+    std::uint64_t MaxAge() const { return m_maxAge; }
+
+    /**
+     * Copies a frame into the ring, dropping however many old frames it takes to make room
+     *
+     * @param data The frame
+     * @param size Size of the frame
+     * @param time When it was shown, in ms on the steady clock. Never less than the last frame's.
+     *
+     * @return false if the ring is off or the frame is bigger than the whole ring
+     */
+    bool Append(const std::uint8_t *data, std::size_t size, std::uint64_t time);
+
+    /**
+     * Finds the frame that was on screen at a given time
+     *
+     * @param time ms on the steady clock
+     * @param[out] entry The last frame at or before time, or the oldest frame if time is before all of them
+     *
+     * @return false if the ring is empty
+     */
+    bool Find(std::uint64_t time, DvrEntry &entry) const;
+
+    /**
+     * The newest frame, if any
+     */
+    bool Newest(DvrEntry &entry) const;
+
+    /**
+     * Data of a frame, valid until the next Append
+     */
+    const std::uint8_t *Data(const DvrEntry &entry) const { return m_buffer.data() + entry.offset; }
+
+  private:
+    std::vector<std::uint8_t> m_buffer;
+
+    /**
+     * Frames in the ring, oldest first
+     */
+    std::deque<DvrEntry> m_index;
+
+    /**
+     * Where the next frame goes
+     */
+    std::size_t m_head{0};
+
+    std::uint64_t m_maxAge{0};
+    std::uint64_t m_sequence{0};
+};
@@ -11,7 +11,6 @@
 struct EmulatorControllerProxy;
 struct EmuCommand;
 struct VideoFormat;
-struct Frame;
 #pragma once
 #include <algorithm>
 #include <bitset>
@@ -35,21 +34,24 @@ struct Frame;
 #include <boost/filesystem.hpp>
 #include <boost/optional.hpp>
 
-#include <tmmintrin.h>
-#include <emmintrin.h>
-#include <mmintrin.h>
-#include <smmintrin.h>
-
 #include "libretro.h"
 
 #include "common/typedefs.h"
 
+#include "CoreHost.h"
+#include "Frame.h"
+#include "FrameMailbox.h"
+#include "FramePacer.h"
 #include "LetsPlayProtocol.h"
 #include "LetsPlayServer.h"
 #include "LetsPlayUser.h"
+#include "PixelConversion.h"
 #include "RetroCore.h"
 #include "RetroPad.h"
+#include "RewindBuffer.h"
+#include "RomImage.h"
 #include "Scheduler.h"
+#include "StateWriter.h"
 
 
 
@@ -73,6 +75,10 @@ enum class kEmuCommandType {
             UserConnect,
     /** Fast forward request **/
             FastForward,
+    /** The recording setting changed in config **/
+            Record,
+    /** Go back in time by value ms **/
+            Rewind,
 };
 
 
@@ -91,6 +97,11 @@ struct EmuCommand {
      *  Who, if anyone, generated the command
      */
     boost::optional<LetsPlayUserHdl> user_hdl;
+
+    /**
+     * Argument of the command, if it has one
+     */
+    std::uint64_t value{0};
 };
 
 /**
@@ -115,9 +126,9 @@ struct EmulatorControllerProxy {
     std::condition_variable *queueNotifier;
 
     /**
-     * Callback for getFrame, used in LetsPlayServer::GenerateEmuJPEG and similar when called by emulator
+     * Pointer to the mailbox holding the latest frame, readable from any thread
      */
-    std::function<Frame()> getFrame;
+    FrameMailbox *frames;
 
     /**
      * Pointer to the joypad object
@@ -142,60 +153,6 @@ struct EmulatorControllerProxy {
  * translate it into a vector representing the RGB colors.
  */
 struct VideoFormat {
-    /*--- Bit masks ---*/
-
-    /* -- 0RGB1555 by default -- */
-
-    /**
-     * Red mask for the current video format
-     */
-    std::atomic<std::uint32_t> rMask{0b1111100000000000};
-
-    /**
-     * Green mask for the current video format
-     */
-    std::atomic<std::uint32_t> gMask{0b0000011111000000};
-
-    /**
-     * Blue mask for the current video format
-     */
-    std::atomic<std::uint32_t> bMask{0b0000000000111110};
-
-    /**
-     * Alpha mask for the current video format
-     *
-     * @note This is typically not used by the RetroArch cores
-     */
-    std::atomic<std::uint32_t> aMask{0b0000000000111110};
-
-    /*--- Bit shifts ---*/
-
-    /**
-     * Red bit shift
-     */
-    std::atomic<std::uint8_t> rShift{10};
-
-    /**
-     * Green bit shift
-     */
-    std::atomic<std::uint8_t> gShift{5};
-
-    /**
-     * Blue bit shift
-     */
-    std::atomic<std::uint8_t> bShift{0};
-
-    /**
-     * Alpha bit shift
-     * @note This typically isn't used by RetroArch cores
-     */
-    std::atomic<std::uint8_t> aShift{15};
-
-    /**
-     * How many bits per pixel
-     */
-    std::atomic<std::uint8_t> bitsPerPel{16};
-
     /**
      * Width of the current video buffer
      */
@@ -216,64 +173,6 @@ struct VideoFormat {
      */
     retro_pixel_format fmt{RETRO_PIXEL_FORMAT_0RGB1555};
 
-    /**
-     * Stride for the video format
-     */
-    std::atomic<std::uint32_t> stride{0};
-
-    /**
-     * Buffer for the video data output
-     */
-    std::vector<std::uint8_t> buffer;
-};
-
-/**
- * @struct Frame
- *
- * Represents a video frame form the RetroArch core.
- */
-struct Frame {
-    /**
-     * Width of the frame in px
-     */
-    std::uint32_t width{0};
-
-    /**
-     * Height of the frame in px
-     */
-    std::uint32_t height{0};
-
-    /**
-     * Stride of the frame in px
-     */
-     std::uint32_t pitch{0};
-
-    /**
-     * Packed RGB array containing the data of the frame
-     */
-    const std::uint8_t* data{nullptr};
-};
-
-/**
- * @union SSE128i
- *
- * Union to allow simpler access to m128i items
- */
-union SSE128i {
-    /**
-     * Underlying vector represented by this data
-     */
-    __m128i vec128i;
-
-    /**
-     * Thing you'd use to access it as if it were a bunch of 16 bit uints
-     */
-    std::uint16_t data16[8];
-
-    /**
-     * Similar to data16
-     */
-    std::uint8_t data8[16];
 };
 
 /**
@@ -394,13 +293,6 @@ namespace EmulatorController {
      */
     bool SetPixelFormat(const retro_pixel_format fmt);
 
-    /**
-     * Gets a frame based on the current video buffer.
-     *
-     * @return The frame representing the current video buffer.
-     */
-    Frame GetFrame();
-
     /**
      * Called by the server periodically to add to the emulator history
      */
@@ -416,6 +308,32 @@ namespace EmulatorController {
      */
     void FastForward();
 
+    /**
+     * Starts the core in a child process and points Core's functions at it
+     *
+     * @param corePath The core the child should load
+     * @param romPath The rom the child should load
+     */
+    bool StartCoreHost(const std::string &corePath, const std::string &romPath);
+
+    /**
+     * Core.Run of an isolated core. Runs a frame in the child and takes the frame it made, restarting the child
+     * from the latest state first if it crashed or stalled.
+     */
+    void RunCoreHost();
+
+    /**
+     * Adds the current state to the rewind buffer
+     */
+    void CaptureRewind();
+
+    /**
+     * Goes back in time using the rewind buffer
+     *
+     * @param ms How far to go back
+     */
+    void Rewind(std::uint64_t ms);
+
     /**
      * Called on emulator controller startup, tries to load save state if possible
      */
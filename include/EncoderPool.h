@@ -0,0 +1,143 @@
+/**
+ * @file EncoderPool.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Worker threads that encode and broadcast emulator frames so the emulator threads don't have to.
+ */
+
+class EncoderPool;
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Frame.h"
+#include "FrameMailbox.h"
+
+/**
+ * @class EncoderPool
+ *
+ * Emulator threads tell the pool that their mailbox has a new frame and go straight back to emulating, while a
+ * fixed number of workers take the latest frame out of the mailbox, encode and send it in the background.
+ *
+ * Every emulator has at most one pending notification. Submitting while the previous one is still pending just
+ * leaves it there, the worker picks up whatever frame is the latest by then, so a pool that can't keep up loses
+ * frames instead of queueing them or slowing the emulators down. Frames of one emulator are never handled by two
+ * workers at once and always go out in order.
+ *
+ * @note thread-safe, but only one thread may submit frames for a given emulator
+ */
+class EncoderPool {
+  public:
+    /**
+     * Called on a worker thread for every frame that wasn't dropped
+     *
+     * @param id Emulator the frame belongs to
+     * @param frame Tightly packed frame, valid until the callback returns
+     * @param duplicate Whether or not the frame is the same one (by mailbox sequence) handed to the last callback
+     */
+    using EncodeCallback = std::function<void(const std::string &id, const Frame &frame, bool duplicate)>;
+
+    ~EncoderPool();
+
+    /**
+     * Starts the workers
+     *
+     * @param threads Number of workers, 0 to pick one based on the number of cores
+     * @param encode What to do with each frame
+     */
+    void Start(std::size_t threads, EncodeCallback encode);
+
+    /**
+     * Stops and joins the workers. Pending frames are discarded.
+     */
+    void Stop();
+
+    /**
+     * Marks the emulator as having a frame to send and wakes up a worker
+     *
+     * @param id Emulator the frame belongs to
+     * @param frames The emulator's mailbox, which has to outlive the pool
+     *
+     * @return false if the previous frame hadn't been picked up yet, and so will be skipped
+     */
+    bool Submit(const std::string &id, FrameMailbox &frames);
+
+  private:
+    /**
+     * @struct Slot
+     *
+     * Work state of one emulator. frames and the flags are guarded by m_Mutex, lastSequence is only touched by the
+     * worker holding the slot.
+     */
+    struct Slot {
+        std::string id;
+        FrameMailbox *frames{nullptr};
+
+        /**
+         * Mailbox sequence of the frame handed to the last callback
+         */
+        std::uint64_t lastSequence{0};
+
+        /**
+         * pending holds a frame that no worker picked up yet
+         */
+        bool hasPending{false};
+
+        /**
+         * A worker is currently handling this emulator
+         */
+        bool busy{false};
+    };
+
+    /**
+     * Worker thread loop
+     */
+    void work();
+
+    /**
+     * One slot per emulator that ever submitted a frame. Slots are never removed, so pointers stay valid.
+     */
+    std::map<std::string, std::unique_ptr<Slot>> m_Slots;
+
+    /**
+     * Slots with a pending frame that no worker is busy with, oldest first
+     */
+    std::deque<Slot *> m_Ready;
+
+    /**
+     * Mutex for m_Slots, m_Ready and the mailbox/flags of every slot
+     */
+    std::mutex m_Mutex;
+
+    /**
+     * Wakes up workers when something is added to m_Ready
+     */
+    std::condition_variable m_Notifier;
+
+    /**
+     * If true, the workers keep running
+     */
+    bool m_Running{false};
+
+    /**
+     * Callback given to Start
+     */
+    EncodeCallback m_Encode;
+
+    /**
+     * Worker threads
+     */
+    std::vector<std::thread> m_Workers;
+};
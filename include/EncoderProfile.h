@@ -0,0 +1,69 @@
+/**
+ * @file EncoderProfile.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Typed jpeg encoder settings, loaded from the named profiles in the config.
+ */
+
+struct EncoderProfile;
+
+#pragma once
+#include <string>
+
+#include <turbojpeg.h>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * @struct EncoderProfile
+ *
+ * Everything that decides how an emulator's frames get compressed. Parsed once from json and then kept around so
+ * the encoder never has to look at the config.
+ *
+ * Profiles are defined in serverConfig.encoderProfiles as
+ *  "name": {"subsampling": "444"|"422"|"420"|"gray", "dct": "accurate"|"fast", "progressive": bool, "quality": 1-100}
+ * and picked per emulator by serverConfig.emulators.<id>.encoderProfile.
+ */
+struct EncoderProfile {
+    /**
+     * Chroma subsampling (TJSAMP_*)
+     */
+    int subsampling{TJSAMP_444};
+
+    /**
+     * Use the faster, less accurate DCT
+     */
+    bool fastDCT{false};
+
+    /**
+     * Encode progressive jpegs (smaller, but slower to encode)
+     */
+    bool progressive{false};
+
+    /**
+     * JPEG quality (1-100)
+     */
+    unsigned quality{80};
+
+    /**
+     * turbojpeg flags for these settings
+     */
+    int Flags() const;
+
+    /**
+     * Parses a profile. Missing fields keep the defaults.
+     *
+     * @param j The profile's json object
+     * @param out Where to store the profile
+     *
+     * @return false if j isn't an object or has an invalid field, in which case out is left alone
+     */
+    static bool FromJSON(const nlohmann::json &j, EncoderProfile &out);
+
+    /**
+     * Name of a TJSAMP_* value as used in the config
+     */
+    static const char *SubsamplingName(int subsampling);
+};
@@ -0,0 +1,47 @@
+/**
+ * @file Frame.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Description of a video frame that is passed between the emulators and whatever consumes their video.
+ */
+
+struct Frame;
+
+#pragma once
+#include <cstdint>
+
+#include "libretro.h"
+
+/**
+ * @struct Frame
+ *
+ * Represents a video frame from the RetroArch core.
+ */
+struct Frame {
+    /**
+     * Width of the frame in px
+     */
+    std::uint32_t width{0};
+
+    /**
+     * Height of the frame in px
+     */
+    std::uint32_t height{0};
+
+    /**
+     * Bytes between the start of two rows
+     */
+    std::uint32_t pitch{0};
+
+    /**
+     * Pixel data of the frame, laid out as described by format
+     */
+    const std::uint8_t* data{nullptr};
+
+    /**
+     * Pixel format of data
+     */
+    retro_pixel_format format{RETRO_PIXEL_FORMAT_XRGB8888};
+};
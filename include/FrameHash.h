@@ -0,0 +1,40 @@
+/**
+ * @file FrameHash.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Fast non-cryptographic hash of a frame's pixels, used to spot frames that didn't change.
+ */
+#pragma once
+#include <cstdint>
+
+#include "Frame.h"
+#include "PixelConversion.h"
+
+/**
+ * @namespace FrameHash
+ *
+ * Hashes the visible pixels of a frame (padding past width in each row is ignored). Uses the same instruction
+ * set level as PixelConversion; every level gives the same result.
+ */
+namespace FrameHash {
+    /**
+     * Hash a frame using the detected instruction set level
+     *
+     * @param frame The frame to hash
+     *
+     * @return 64-bit hash of the frame's size, format and pixels
+     */
+    std::uint64_t Hash(const Frame &frame);
+
+    /**
+     * Hash a frame at a specific instruction set level
+     *
+     * @param frame The frame to hash
+     * @param level The instruction set to use. Must be supported by the running CPU.
+     *
+     * @return 64-bit hash of the frame's size, format and pixels
+     */
+    std::uint64_t Hash(const Frame &frame, PixelConversion::kSimdLevel level);
+}
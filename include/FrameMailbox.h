@@ -0,0 +1,164 @@
+/**
+ * @file FrameMailbox.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Lock-free latest-frame mailbox between an emulator and whatever reads its video.
+ */
+
+class FrameMailbox;
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Frame.h"
+
+/**
+ * @class FrameMailbox
+ *
+ * Triple buffer that always holds the newest complete frame of an emulator. The emulator copies every new frame out
+ * of the core's memory into a slot nobody is reading and publishes it with a single atomic store, readers take a
+ * snapshot of whatever was published last. Neither side ever waits on the other: the core is free to overwrite its
+ * own buffer as soon as Publish returns, and a snapshot stays valid for as long as it's held.
+ *
+ * Cores that support GET_CURRENT_SOFTWARE_FRAMEBUFFER can render straight into a free slot (see Claim), in which
+ * case publishing the frame doesn't copy anything at all.
+ *
+ * @note Any number of threads may read, but only one (the emulator's) may publish. With three slots the writer always
+ * finds a free one as long as at most one snapshot of an older frame is held at a time; otherwise the frame is
+ * skipped rather than waited on.
+ */
+class FrameMailbox {
+    /**
+     * @struct Slot
+     *
+     * One frame and the buffer backing it
+     */
+    struct Slot {
+        std::vector<std::uint8_t> pixels;
+        Frame frame;
+        std::uint64_t sequence{0};
+
+        /**
+         * Snapshots currently held of this slot, the writer only takes slots without any
+         */
+        std::atomic<std::uint32_t> readers{0};
+    };
+
+  public:
+    /**
+     * Number of frame buffers
+     */
+    static constexpr std::size_t kSlots = 3;
+
+    /**
+     * @class Snapshot
+     *
+     * Read access to a published frame, which isn't written to until every snapshot of it is gone
+     */
+    class Snapshot {
+      public:
+        Snapshot() = default;
+        Snapshot(Snapshot &&other) noexcept;
+        Snapshot &operator=(Snapshot &&other) noexcept;
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+        ~Snapshot();
+
+        /**
+         * Whether or not a frame was published at the time the snapshot was taken
+         */
+        explicit operator bool() const { return m_slot != nullptr; }
+
+        /**
+         * The frame, tightly packed and in the core's pixel format. An empty frame if nothing was published yet.
+         */
+        const Frame &frame() const;
+
+        /**
+         * Counts up by one for every published frame, so two snapshots with the same sequence hold the same frame
+         */
+        std::uint64_t sequence() const;
+
+      private:
+        friend class FrameMailbox;
+        explicit Snapshot(Slot *slot) : m_slot(slot) {}
+
+        /**
+         * Slot held, nullptr if none
+         */
+        Slot *m_slot{nullptr};
+    };
+
+    /**
+     * Lends out a free slot for the next frame to be rendered into. Publishing a frame whose data is the returned
+     * buffer (with the same size) makes that slot the latest one without a copy. Claiming again before publishing
+     * hands out the same slot if the size still fits.
+     *
+     * @param width Width of the frame in px
+     * @param height Height of the frame in px
+     * @param format Pixel format of the frame
+     * @param[out] pitch Bytes between the start of two rows of the returned buffer
+     *
+     * @return The buffer, or nullptr if every other slot is still being read
+     *
+     * @note Only called by the thread that owns the mailbox
+     */
+    std::uint8_t *Claim(std::uint32_t width, std::uint32_t height, retro_pixel_format format, std::size_t &pitch);
+
+    /**
+     * Copies a frame into a free slot (unless it was rendered into a claimed one) and makes it the latest one
+     *
+     * @param frame The frame, its memory only has to stay valid for the duration of the call
+     *
+     * @return false if every other slot is still being read, in which case the frame is skipped
+     *
+     * @note Only called by the thread that owns the mailbox
+     */
+    bool Publish(const Frame &frame);
+
+    /**
+     * Takes a snapshot of the most recently published frame
+     */
+    Snapshot Latest();
+
+    /**
+     * Sequence number of the most recently published frame, 0 if none
+     */
+    std::uint64_t Sequence() const;
+
+  private:
+    std::array<Slot, kSlots> m_slots;
+
+    /**
+     * Index of the slot holding the latest frame, -1 if none
+     */
+    std::atomic<int> m_latest{-1};
+
+    /**
+     * Frames published so far
+     */
+    std::atomic<std::uint64_t> m_sequence{0};
+
+    /**
+     * Slot handed out by Claim that wasn't published yet, -1 if none. Only touched by the writer.
+     */
+    int m_claimed{-1};
+
+    /**
+     * Index of a slot that isn't the latest one and isn't being read, -1 if there is none
+     *
+     * @note Only called by the writer
+     */
+    int freeSlot() const;
+
+    /**
+     * Makes a written slot the latest one
+     */
+    void publish(int index);
+};
@@ -0,0 +1,122 @@
+/**
+ * @file FramePacer.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Keeps an emulator loop running at the core's exact frame rate.
+ */
+
+class FramePacer;
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @class FramePacer
+ *
+ * Schedules frames against absolute deadlines (start + n * period), so rounding and time spent between frames never
+ * add up to drift. Waiting sleeps until shortly before the deadline and then spins for the rest, since sleeps can
+ * overshoot by a good fraction of a millisecond.
+ *
+ * Falling behind by less than a frame is made up by the next wait being shorter. Falling behind by a whole frame or
+ * more (a stall: a slow save, the machine being busy, ...) restarts the schedule from now instead of running the
+ * missed frames back to back.
+ *
+ * @note Not thread-safe, used by the emulator's own thread
+ */
+class FramePacer {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * How long before a deadline to stop sleeping and start spinning
+     */
+    static constexpr std::chrono::microseconds kSpinWindow{500};
+
+    /**
+     * @struct Stats
+     *
+     * How well the deadlines were kept since the stats were last taken
+     */
+    struct Stats {
+        /**
+         * Frames waited for
+         */
+        std::uint64_t frames{0};
+
+        /**
+         * Frames whose deadline had already passed when Wait was called
+         */
+        std::uint64_t missed{0};
+
+        /**
+         * Times the schedule was restarted after falling a frame or more behind
+         */
+        std::uint64_t stalls{0};
+
+        /**
+         * How far past the deadline the waits that were on time returned, in us
+         */
+        double meanJitter{0};
+        double maxJitter{0};
+    };
+
+    FramePacer();
+
+    /**
+     * Sets the frame rate. Takes effect from the next deadline on; the frames already scheduled don't move.
+     *
+     * @param fps Frames per second, as reported by the core. Anything not positive is taken as 60.
+     * @param speed Multiplier for fast forward and the like
+     */
+    void SetRate(double fps, double speed = 1.0);
+
+    /**
+     * When the next frame should run
+     */
+    clock::time_point NextDeadline() const { return m_deadline; }
+
+    /**
+     * Blocks until the next deadline, then schedules the one after it
+     */
+    void Wait();
+
+    /**
+     * Returns the stats gathered so far and starts over
+     */
+    Stats TakeStats();
+
+  private:
+    /**
+     * Deadlines are counted from here, moved whenever the rate changes or after a stall
+     */
+    clock::time_point m_epoch;
+
+    /**
+     * Frames scheduled since m_epoch
+     */
+    std::uint64_t m_frame{0};
+
+    /**
+     * Time between two frames, in (fractional) ns
+     */
+    std::chrono::duration<double, std::nano> m_period;
+
+    clock::time_point m_deadline;
+
+    double m_fps{0}, m_speed{0};
+
+    Stats m_stats;
+
+    /**
+     * Sum of the jitter in m_stats, for the mean
+     */
+    double m_jitterSum{0};
+
+    /**
+     * Starts counting deadlines from start
+     */
+    void restart(clock::time_point start);
+};
@@ -0,0 +1,166 @@
+/**
+ * @file JpegEncoderPool.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Pool of turbojpeg compressors and the buffers they write into, shared by every thread that encodes jpegs.
+ */
+
+class JpegEncoderPool;
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <turbojpeg.h>
+
+/**
+ * @class JpegEncoderPool
+ *
+ * Hands out encoder contexts (a tjhandle plus output and scratch buffers). A context is only handed out again once
+ * whoever had it dropped their reference, so there are only ever as many contexts as there are jpegs being worked on
+ * at the same time, no matter how many threads encode now and then. Buffers only grow while they're in use (one
+ * context encodes full size and downscaled renditions in turn) and are trimmed once they've been mostly unused for a
+ * while.
+ *
+ * @note thread-safe
+ */
+class JpegEncoderPool {
+  public:
+    struct Context;
+
+    /**
+     * @struct Buffer
+     *
+     * Uninitialized bytes, sized by Context::Fit. Unlike a vector, growing doesn't zero-fill what turbojpeg or the
+     * pixel conversion is about to overwrite anyway.
+     */
+    struct Buffer {
+        std::uint8_t *data() { return m_data.get(); }
+        const std::uint8_t *data() const { return m_data.get(); }
+
+        /**
+         * Size asked for by the last Fit
+         */
+        std::size_t size() const { return m_size; }
+
+        /**
+         * Bytes actually allocated
+         */
+        std::size_t capacity() const { return m_capacity; }
+
+      private:
+        friend struct Context;
+
+        std::unique_ptr<std::uint8_t[]> m_data;
+        std::size_t m_size{0}, m_capacity{0};
+
+        /**
+         * Fits in a row that needed less than half of the capacity
+         */
+        std::uint32_t m_smallFits{0};
+    };
+
+    /**
+     * @struct Context
+     *
+     * Everything needed to compress one jpeg
+     */
+    struct Context {
+        explicit Context(JpegEncoderPool &pool);
+        ~Context();
+        Context(const Context &) = delete;
+        Context &operator=(const Context &) = delete;
+
+        /**
+         * Sizes the output buffer for a width x height jpeg using subsampling subsamp, plus a free byte in front
+         * for the binary message header
+         *
+         * @return Where turbojpeg should write the jpeg (one past the header byte)
+         */
+        std::uint8_t *ReserveOutput(std::uint32_t width, std::uint32_t height, int subsamp);
+
+        /**
+         * Makes one of the buffers hold at least size bytes. Memory is only given back once the buffer has been
+         * more than twice too big kTrimAfter times in a row.
+         */
+        void Fit(Buffer &buffer, std::size_t size);
+
+        /**
+         * About a few seconds' worth of frames at the smaller renditions
+         */
+        static constexpr std::uint32_t kTrimAfter = 300;
+
+        /**
+         * Compressor, created once per context
+         */
+        tjhandle handle;
+
+        /**
+         * Jpeg output, the first byte is left for the binary message header
+         */
+        Buffer output;
+
+        /**
+         * Scratch space for Y/Cb/Cr planes, converted and downscaled pixels
+         */
+        Buffer yuv, rgb, scaled;
+
+      private:
+        /**
+         * Pool to report buffer sizes to
+         */
+        JpegEncoderPool &m_pool;
+
+        /**
+         * Bytes held by the buffers above as last reported to the pool
+         */
+        std::size_t m_bytes{0};
+
+        /**
+         * Reports the current buffer capacity to the pool
+         */
+        void account();
+    };
+
+    /**
+     * Shared pointer to a context, the context is free again once only the pool holds it
+     */
+    using context_ptr = std::shared_ptr<Context>;
+
+    /**
+     * Get a context that nobody is using, creating one if they're all busy
+     */
+    context_ptr Acquire();
+
+    /**
+     * Number of contexts created so far
+     */
+    std::size_t ContextCount();
+
+    /**
+     * Bytes held by the buffers of every context
+     */
+    std::size_t MemoryUsage() const;
+
+  private:
+    /**
+     * Contexts owned by the pool
+     */
+    std::vector<context_ptr> m_Contexts;
+
+    /**
+     * Mutex for accessing m_Contexts
+     */
+    std::mutex m_Mutex;
+
+    /**
+     * Sum of the buffer capacity of every context
+     */
+    std::atomic<std::size_t> m_Bytes{0};
+};
@@ -36,13 +36,24 @@ class LetsPlayServer;
 #include "md5.h"
 
 #include "common/typedefs.h"
+#include "DirtyTileTracker.h"
+#include "DvrRing.h"
 #include "EmulatorController.h"
+#include "EncoderPool.h"
+#include "EncoderProfile.h"
+#include "FrameHash.h"
+#include "JpegEncoderPool.h"
 #include "LetsPlayConfig.h"
 #include "LetsPlayProtocol.h"
 #include "LetsPlayUser.h"
 #include "Logging.hpp"
+#include "LosslessCodec.h"
+#include "PixelConversion.h"
 #include "Random.h"
 #include "Scheduler.h"
+#include "SessionRecorder.h"
+#include "SharedMessagePool.h"
+#include "StateWriter.h"
 
 typedef websocketpp::server<websocketpp::config::asio> wcpp_server;
 
@@ -85,6 +96,28 @@ enum class kCommandType {
             FastForward,
     /** Internal: Sends off previews to a user */
             Preview,
+    /** Client supports delta screen messages */
+            Delta,
+    /** Client wants a full frame */
+            Keyframe,
+    /** Admin request for per-user stream stats */
+            Stats,
+    /** Pick a stream rendition */
+            Rendition,
+    /** Client supports lossless screen messages */
+            Lossless,
+    /** Admin request to benchmark the encoder profiles */
+            Benchmark,
+    /** Admin request to turn recording on or off */
+            Record,
+    /** Admin request for the list of recording sessions */
+            Recordings,
+    /** Admin request to export part of a recording session */
+            Export,
+    /** Rewind the stream or go back to live */
+            Replay,
+    /** Admin request to rewind the emulator itself */
+            Rewind,
     Unknown,
 };
 
@@ -98,6 +131,189 @@ enum kBinaryMessageType {
             Screen,
     /** Emulator preview message **/
             Preview,
+    /** Changed areas of the screen since the last screen/delta message **/
+            DeltaScreen,
+    /** Screen update message using LosslessCodec instead of jpeg **/
+            LosslessScreen,
+};
+
+/**
+ * @struct Rendition
+ *
+ * One rung of the stream ladder (e.g. full size q80, half size q60, ...). Every rendition is encoded at most once
+ * per frame and shared by everyone watching it.
+ */
+struct Rendition {
+    /**
+     * Name used by clients to pick the rendition
+     */
+    std::string name;
+
+    /**
+     * Width and height are divided by this
+     */
+    unsigned scale{1};
+
+    /**
+     * JPEG quality (1-100), 0 to use the quality of the emulator's encoder profile
+     */
+    unsigned quality{0};
+
+    /**
+     * Only every nth frame is sent
+     */
+    std::uint64_t frameInterval{1};
+};
+
+/**
+ * How many frames in a row a connection has to keep up with room to spare before it's automatically moved to the
+ * next better rendition
+ */
+constexpr std::uint32_t kRenditionStepUpFrames = 300;
+
+/**
+ * How many times each profile encodes the frame in LetsPlayServer::BenchmarkEncoderProfiles
+ */
+constexpr unsigned kBenchmarkRuns = 30;
+
+/**
+ * @struct EmuStream
+ *
+ * Per-emulator state of the outgoing video stream
+ *
+ * @note Only touched by the encoder worker currently sending the frames for that emulator
+ */
+struct EmuStream {
+    /**
+     * Finds what changed between frames for delta screen messages
+     */
+    DirtyTileTracker tiles;
+
+    /**
+     * Frames sent since everyone last got a full frame
+     */
+    std::uint64_t framesSinceKeyframe{0};
+
+    /**
+     * How many frames to go between full frames, loaded from config on every keyframe
+     */
+    std::uint64_t keyframeInterval{300};
+
+    /**
+     * Bytes that may be waiting to be sent on a connection before it stops getting new frames, loaded from config
+     * on every keyframe
+     */
+    std::uint64_t maxBufferedBytes{262144};
+
+    /**
+     * How long a connection may go without catching up before it's closed, loaded from config on every keyframe
+     */
+    std::chrono::milliseconds stallTimeout{15000};
+
+    /**
+     * How frames get compressed, loaded from config on every keyframe
+     */
+    EncoderProfile profile;
+
+    /**
+     * Name of profile in the config
+     */
+    std::string profileName;
+
+    /**
+     * Whether or not the settings above were loaded from config yet
+     */
+    bool settingsLoaded{false};
+
+    /**
+     * Frames looked at so far, used for the frame interval of each rendition
+     */
+    std::uint64_t frameCount{0};
+
+    /**
+     * One entry per rendition. Set when a changed frame was skipped because the rendition wasn't due for one.
+     */
+    std::vector<bool> renditionStale;
+
+    /**
+     * One entry per rendition. Size of the last jpeg made for it per pixel, 0 if none was made yet.
+     */
+    std::vector<double> jpegBytesPerPixel;
+
+    /**
+     * One entry per rendition. The jpeg message made for the frame being sent, if any. Empty between frames, only
+     * kept here so the slots aren't allocated for every frame.
+     */
+    std::vector<SharedMessagePool::message_ptr> jpegMessages;
+
+    /**
+     * Hash of the last frame that was looked at, used to skip frames that didn't change
+     */
+    std::uint64_t lastHash{0};
+
+    /**
+     * Whether or not lastHash is set
+     */
+    bool hasLastHash{false};
+
+    /**
+     * Set by LetsPlayServer::GeneratePreview, the next frame that goes through the encoder is also made into a
+     * preview thumbnail
+     *
+     * @note Unlike the rest of the struct this is set from the emulator's thread
+     */
+    std::atomic<bool> previewRequested{false};
+
+    /**
+     * Archive of the full size jpegs, running while the emulator's recording setting is on. Checked on every
+     * keyframe.
+     */
+    SessionRecorder recorder;
+
+    /**
+     * The last few seconds of full size jpegs, for viewers that rewind. Sized from config on every keyframe.
+     */
+    DvrRing dvr;
+};
+
+/**
+ * @struct EmuPreview
+ *
+ * Preview thumbnail of an emulator, shown in the emulator list
+ */
+struct EmuPreview {
+    /**
+     * Binary preview message, the header byte followed by the jpeg
+     */
+    std::vector<std::uint8_t> message;
+
+    /**
+     * Quoted HTTP entity tag for the jpeg. Made from the frame hash and the thumbnail settings, so it only
+     * changes when the picture does.
+     */
+    std::string etag;
+};
+
+/**
+ * @struct EncodedFrame
+ *
+ * View of an encoded frame. The first byte is left free for the binary message header.
+ */
+struct EncodedFrame {
+    /**
+     * Start of the data (the header byte)
+     */
+    const std::uint8_t *data{nullptr};
+
+    /**
+     * Size of the data, including the header byte
+     */
+    std::size_t size{0};
+
+    /**
+     * Encoder context whose buffer data points into, held so that nobody else encodes into it meanwhile
+     */
+    JpegEncoderPool::context_ptr context;
 };
 
 /**
@@ -242,13 +458,54 @@ class LetsPlayServer {
     /**
      * Object to store emulator previews
      */
-    std::map<EmuID_t, std::vector<std::uint8_t>> m_Previews;
+    std::map<EmuID_t, EmuPreview> m_Previews;
 
     /**
      * Mutex for accessing/modifying m_Previews
      */
     std::mutex m_PreviewsMutex;
 
+    /**
+     * Messages used to broadcast screen updates. Each frame is framed once and shared by every viewer.
+     */
+    SharedMessagePool m_FrameMessages;
+
+    /**
+     * Jpeg compressors and their buffers, shared by the encoder workers and the emulator threads
+     */
+    JpegEncoderPool m_JpegContexts;
+
+    /**
+     * Workers that encode and broadcast frames off of the emulator threads
+     */
+    EncoderPool m_Encoder;
+
+    /**
+     * Writes recording exports one at a time, off of the work queue
+     */
+    StateWriter m_Exports;
+
+    /**
+     * Thread running the last encoder benchmark, and whether it's still going
+     */
+    std::thread m_BenchmarkThread;
+    std::atomic<bool> m_BenchmarkRunning{false};
+
+    /**
+     * Stream ladder loaded from config on startup, best first. Never empty and not modified afterwards.
+     */
+    std::vector<Rendition> m_Renditions;
+
+    /**
+     * Video stream state for each emulator
+     */
+    std::map<EmuID_t, EmuStream> m_Streams;
+
+    /**
+     * Mutex for adding to/looking up m_Streams
+     */
+    std::mutex m_StreamsMutex;
+
     /**
      * IP -> IPData for mutes
      */
@@ -440,7 +697,8 @@ public:
     void AddEmu(const EmuID_t& id, EmulatorControllerProxy *emu);
 
     /**
-     * Called when an emulator controller has a frame update
+     * Called when an emulator controller has a frame update. Tells the encoder pool and returns, the latest frame
+     * in the emulator's mailbox is encoded and sent by broadcastFrame on a worker thread.
      * @param id The id of the caller
      *
      * @note Only called by EmulatorControllers
@@ -448,7 +706,8 @@ public:
     void SendFrame(const EmuID_t& id);
 
     /**
-     * Generate preview thumbnails
+     * Asks for a new preview thumbnail. The current frame is handed to the encoder pool, which shrinks it into a
+     * thumbnail in broadcastFrame.
      */
     void GeneratePreview(const EmuID_t &id);
 
@@ -457,6 +716,35 @@ public:
      */
     std::vector<std::uint8_t> GenerateEmuJPEG(const EmuID_t &id);
 
+    /**
+     * Generates a jpeg from the display currently on an emulator without copying it out of the encoder's buffer
+     *
+     * @return A view of the jpeg (with a free header byte in front), valid for as long as the result is held
+     */
+    EncodedFrame EncodeEmuJPEG(const EmuID_t &id);
+
+    /**
+     * Compresses a frame into a jpeg. Works on windows into a frame as well, as long as the pitch is kept. Empty
+     * frames give a placeholder with no image data.
+     *
+     * @param frame The frame to compress
+     * @param profile Encoder settings to use
+     * @param scale Integer factor to shrink the frame by before compressing
+     *
+     * @return A view of the jpeg (with a free header byte in front), valid for as long as the result is held
+     */
+    EncodedFrame CompressJPEG(const Frame &frame, const EncoderProfile &profile, unsigned scale);
+
+    /**
+     * Encodes the current frame of an emulator with every encoder profile in the config, logs the time and size
+     * for each and sends them to the user that asked
+     * @param id The emulator
+     * @param user_hdl Who asked
+     *
+     * @note Called on its own thread, the frame is copied so the emulator keeps running meanwhile
+     */
+    void BenchmarkEncoderProfiles(const EmuID_t& id, LetsPlayUserHdl user_hdl);
+
     /**
      * Replaces ~ in file paths with the path to the current user's home directory.
      * @param str
@@ -491,4 +779,93 @@ public:
      * @param file_path Path to the file to send
      */
     static void sendHTTPFile(wcpp_server::connection_ptr& cptr, boost::filesystem::path file_path, websocketpp::http::status_code::value);
+
+    /**
+     * Encodes a frame and sends it to everyone connected to the emulator. Runs on an encoder worker.
+     * @param id The emulator the frame came from
+     * @param frame The frame
+     * @param duplicate Whether or not this is the same frame as the last one (the core presented a dupe)
+     *
+     * @note Frames that are identical to the last one are only sent to viewers waiting on a full frame.
+     */
+    void broadcastFrame(const EmuID_t& id, const Frame& frame, bool duplicate);
+
+    /**
+     * Shrinks a frame into a preview thumbnail and stores it in m_Previews, unless the stored one already shows
+     * the same picture. Runs on an encoder worker.
+     * @param id The emulator the frame came from
+     * @param frame The frame
+     * @param hash FrameHash of the frame
+     * @param profile Encoder settings of the emulator, the quality is replaced by the preview quality
+     */
+    void updatePreview(const EmuID_t& id, const Frame& frame, std::uint64_t hash, EncoderProfile profile);
+
+    /**
+     * Acts on a user's replay request, moving them to the DVR or back to live and telling them about it
+     * @param user Who asked
+     * @param hdl Their connection
+     * @param stream Stream of the emulator they're on
+     * @param now ms on the steady clock
+     */
+    void startReplay(LetsPlayUser& user, websocketpp::connection_hdl hdl, const EmuStream& stream, std::uint64_t now);
+
+    /**
+     * Sends every rewound viewer the DVR frame for where their playback is at, if it changed since the last one.
+     * Viewers that caught up with the live stream are moved back to it.
+     * @param stream Stream of the emulator
+     * @param viewers The rewound viewers
+     * @param now ms on the steady clock
+     */
+    void serveReplays(const EmuStream& stream,
+                      const std::vector<std::pair<websocketpp::connection_hdl, std::shared_ptr<LetsPlayUser>>>& viewers,
+                      std::uint64_t now);
+
+    /**
+     * Moves a user to another rendition and tells them about it
+     * @param user Who to move
+     * @param hdl Their connection
+     * @param rendition Index into m_Renditions
+     */
+    void setRendition(LetsPlayUser& user, websocketpp::connection_hdl hdl, std::size_t rendition);
+
+    /**
+     * Loads m_Renditions from config, skipping invalid entries
+     */
+    void loadRenditions();
+
+    /**
+     * Looks up an encoder profile from serverConfig.encoderProfiles
+     * @param name Name of the profile
+     * @param out Where to store the profile
+     *
+     * @return false if the profile doesn't exist or is invalid, in which case out is left alone
+     */
+    bool lookupEncoderProfile(const std::string& name, EncoderProfile& out);
+
+    /**
+     * Reloads the config values cached in an emulator's stream state
+     */
+    void refreshStreamSettings(const EmuID_t& id, EmuStream& stream);
+
+    /**
+     * Builds a delta screen message out of the changed areas of a frame
+     * @param frame The frame the tracker was just updated with
+     * @param tiles Tracker holding the changed areas
+     * @param profile Encoder settings for the changed areas
+     * @param payload Where to write the message
+     */
+    void encodeDeltaFrame(const Frame& frame, const DirtyTileTracker& tiles, const EncoderProfile& profile,
+                          std::string& payload);
+
+    /**
+     * Sends a shared message to a group of connections
+     * @param hdls Who to send to
+     * @param msg The prepared message
+     */
+    void sendShared(const std::vector<websocketpp::connection_hdl>& hdls, const SharedMessagePool::message_ptr& msg);
+
+    /**
+     * Appends the lowest bytes of value to out, little endian
+     */
+    static void appendLittleEndian(std::string& out, std::uint32_t value, std::size_t bytes);
 };
@@ -8,7 +8,9 @@ class LetsPlayUser;
 
 #pragma once
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <map>
 #include <mutex>
 #include <string>
@@ -83,6 +85,21 @@ class LetsPlayUser {
      */
     std::mutex m_muting;
 
+    /**
+     * Time point for when the connection fell behind on frames
+     */
+    std::chrono::time_point<std::chrono::steady_clock> m_behindSince;
+
+    /**
+     * Whether or not the connection is currently behind on frames
+     */
+    bool m_behind{false};
+
+    /**
+     * Mutex for m_behindSince and m_behind
+     */
+    std::mutex m_flow;
+
 
 public:
     /**
@@ -105,6 +122,63 @@ public:
      */
     std::atomic<bool> hasAdmin;
 
+    /**
+     * Whether or not the client understands delta screen messages
+     */
+    std::atomic<bool> supportsDelta;
+
+    /**
+     * Whether or not the client should get a full frame next instead of a delta
+     */
+    std::atomic<bool> needsKeyframe;
+
+    /**
+     * Whether or not the client understands lossless screen messages
+     */
+    std::atomic<bool> supportsLossless;
+
+    /**
+     * Frames that were skipped because the connection was still busy sending older ones
+     */
+    std::atomic<std::uint64_t> framesDropped;
+
+    /**
+     * Index of the rendition the user is watching
+     */
+    std::atomic<std::size_t> rendition;
+
+    /**
+     * Whether or not the server may move the user between renditions based on how well they keep up
+     */
+    std::atomic<bool> autoRendition;
+
+    /**
+     * Frames in a row the user kept up with while having room to spare
+     */
+    std::atomic<std::uint32_t> smoothFrames;
+
+    /**
+     * How far back (in ms) the user asked to rewind the stream, 0 to go back to live. Read once replayRequested is
+     * set.
+     */
+    std::atomic<std::uint64_t> replayOffset;
+
+    /**
+     * Set when a replay request came in that the encoder worker hasn't acted on yet
+     */
+    std::atomic<bool> replayRequested;
+
+    /**
+     * Whether or not the user is watching from the emulator's DVR instead of live
+     */
+    std::atomic<bool> replaying;
+
+    /**
+     * Where in the DVR playback started and when (both ms on the steady clock), and the last DVR frame sent. Only
+     * touched by the encoder worker.
+     */
+    std::uint64_t replayFrom{0}, replayStartedAt{0}, replayLastSequence{0};
+
     LetsPlayUser();
 
     /*
@@ -159,4 +233,21 @@ public:
      * Whether or not the user should disconnect (missed two pongs)
      */
     bool shouldDisconnect();
+
+    /**
+     * Mark the connection as behind on frames
+     *
+     * @return How long it has been behind for, without catching up in between
+     */
+    std::chrono::milliseconds markBehind();
+
+    /**
+     * Mark the connection as caught up
+     */
+    void markCaughtUp();
+
+    /**
+     * Whether or not the connection is currently behind on frames
+     */
+    bool isBehind();
 };
\ No newline at end of file
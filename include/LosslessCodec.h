@@ -0,0 +1,45 @@
+/**
+ * @file LosslessCodec.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Lossless palette + run length codec for frames with few colours (i.e. most pixel art).
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Frame.h"
+
+/**
+ * @namespace LosslessCodec
+ *
+ * Encodes 16-bit frames with at most kMaxColours distinct colours as a palette and a run length coded stream of
+ * palette indices. Way cheaper to encode than a jpeg and pixel exact, and usually smaller on pixel art.
+ *
+ * Layout (all integers little endian):
+ *  u16 width, u16 height, u16 palette size,
+ *  palette size * (u8 red, u8 green, u8 blue),
+ *  then ops over the indices of the whole frame in row major order (runs can span rows):
+ *      0b00nnnnnn: n + 1 literal indices follow
+ *      0b01nnnnnn: one index follows, repeated n + 1 times
+ *      0b10nnnnnn: copy n + 1 indices from the row above
+ */
+namespace LosslessCodec {
+    /**
+     * Most colours a frame can have to be encoded
+     */
+    constexpr std::size_t kMaxColours = 256;
+
+    /**
+     * Encodes a frame
+     *
+     * @param frame The frame to encode
+     * @param out Where to append the encoded frame
+     *
+     * @return false if the frame can't be encoded (not a 16-bit format or too many colours). out is left as it was.
+     */
+    bool Encode(const Frame &frame, std::string &out);
+}
@@ -0,0 +1,112 @@
+/**
+ * @file MappedFile.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Memory mapped file, either appended to or read.
+ */
+
+class MappedFile;
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <boost/filesystem.hpp>
+
+/**
+ * @class MappedFile
+ *
+ * A file mapped into memory. Files that are created are made capacity bytes big up front and then filled from the
+ * front by Append, so writing is a memcpy and the OS writes the pages back in the background. Closing the file cuts
+ * it down to what was actually appended.
+ *
+ * @note Not thread-safe
+ */
+class MappedFile {
+  public:
+    MappedFile() = default;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    /**
+     * Creates (or replaces) a file of capacity bytes, with its disk space allocated up front, and maps it for writing
+     *
+     * @return false if the file couldn't be created, allocated (e.g. the disk is full) or mapped
+     */
+    bool Create(const boost::filesystem::path &path, std::size_t capacity);
+
+    /**
+     * Maps an existing file read-only
+     *
+     * @return false if the file couldn't be opened or mapped (empty files can't be mapped)
+     */
+    bool Open(const boost::filesystem::path &path);
+
+    /**
+     * Maps an existing file read-only, sharing the mapping with everyone else who has the same file open this way
+     *
+     * Files are told apart by device, inode, size and modification time, so a file that was replaced gets mapped
+     * anew. The mapping goes away with the last pointer to it.
+     *
+     * @return nullptr if the file couldn't be opened or mapped
+     */
+    static std::shared_ptr<const MappedFile> OpenShared(const boost::filesystem::path &path);
+
+    /**
+     * Copies data to the end of what was appended so far
+     *
+     * @param[out] offset Where in the file the data went
+     *
+     * @return false if it doesn't fit in the remaining capacity (nothing is written then)
+     */
+    bool Append(const void *data, std::size_t size, std::size_t &offset);
+
+    /**
+     * Unmaps the file. Created files are flushed and truncated to the appended size first.
+     */
+    void Close();
+
+    /**
+     * Whether or not a file is mapped
+     */
+    bool IsOpen() const { return m_data != nullptr; }
+
+    /**
+     * Start of the mapping
+     */
+    const std::uint8_t *Data() const { return m_data; }
+
+    /**
+     * Bytes appended so far for created files, the file size for opened ones
+     */
+    std::size_t Size() const { return m_size; }
+
+    /**
+     * Size of the mapping
+     */
+    std::size_t Capacity() const { return m_capacity; }
+
+  private:
+    /**
+     * File descriptor, -1 if none
+     */
+    int m_fd{-1};
+
+    /**
+     * The mapping, nullptr if none
+     */
+    std::uint8_t *m_data{nullptr};
+
+    std::size_t m_size{0}, m_capacity{0};
+
+    /**
+     * Whether or not the file was created (and so is written to)
+     */
+    bool m_writable{false};
+};
@@ -0,0 +1,162 @@
+/**
+ * @file PixelConversion.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Kernels that translate the 16-bit libretro pixel formats into XRGB8888 or planar YCbCr. Every
+ *  format gets its own compile-time specialized kernel, and the instruction set
+ *  used (scalar, SSSE3, AVX2) is picked once at startup based on what the CPU supports.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "libretro.h"
+
+/**
+ * @namespace PixelConversion
+ *
+ * Pixel format conversion kernels and the runtime dispatch for them.
+ *
+ * @note The output format is the libretro XRGB8888 format, i.e. every pixel is a native
+ * endian 32-bit integer 0x00RRGGBB. On little endian machines that lays out in memory as
+ * B, G, R, X, which is TJPF_BGRX in turbojpeg terms.
+ */
+namespace PixelConversion {
+    /**
+     * @enum kSimdLevel
+     *
+     * Instruction set levels that kernels are provided for
+     */
+    enum class kSimdLevel {
+        /** Plain C++, used as the reference implementation **/
+                Scalar,
+        /** 128-bit kernels (8 pixels per iteration) **/
+                SSSE3,
+        /** 256-bit kernels (16 pixels per iteration) **/
+                AVX2,
+    };
+
+    /**
+     * Converts one row of pixels. Reads exactly width pixels from src and writes exactly
+     * width * 4 bytes to dst.
+     */
+    using RowConverter = void (*)(const std::uint8_t *src, std::uint8_t *dst, std::size_t width);
+
+    /**
+     * Converts one row of pixels into the Y, Cb and Cr planes (JFIF full range). Reads exactly width
+     * pixels from src and writes exactly width bytes to each plane.
+     */
+    using YUVRowConverter = void (*)(const std::uint8_t *src, std::uint8_t *y, std::uint8_t *cb, std::uint8_t *cr,
+                                     std::size_t width);
+
+    /**
+     * Bytes per pixel of a libretro pixel format
+     */
+    inline std::size_t BytesPerPixel(retro_pixel_format fmt) {
+        return fmt == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2;
+    }
+
+    /**
+     * The best instruction set level supported by the running CPU. Detected once on first call.
+     */
+    kSimdLevel DetectedSimdLevel();
+
+    /**
+     * Human readable name for a kSimdLevel, used for logging
+     */
+    const char *SimdLevelName(kSimdLevel level);
+
+    /**
+     * Gets the row converter for a pixel format using the detected instruction set level.
+     *
+     * @param fmt The format of the source pixels
+     *
+     * @return The converter, or nullptr if fmt isn't a 16-bit format
+     */
+    RowConverter XRGB8888Converter(retro_pixel_format fmt);
+
+    /**
+     * Gets the row converter for a pixel format at a specific instruction set level.
+     *
+     * @param fmt The format of the source pixels
+     * @param level The instruction set to use. Must be supported by the running CPU.
+     *
+     * @return The converter, or nullptr if fmt isn't a 16-bit format
+     */
+    RowConverter XRGB8888Converter(retro_pixel_format fmt, kSimdLevel level);
+
+    /**
+     * Converts a whole frame, one row at a time. Rows are never read or written past width pixels
+     * so the source and destination pitches can be anything >= the row size.
+     *
+     * @param convert The row converter to use
+     * @param src First pixel of the source frame
+     * @param srcPitch Bytes between the start of two source rows
+     * @param dst First pixel of the destination frame
+     * @param dstPitch Bytes between the start of two destination rows
+     * @param width Width in pixels
+     * @param height Height in pixels
+     */
+    void ConvertFrame(RowConverter convert, const std::uint8_t *src, std::size_t srcPitch,
+                      std::uint8_t *dst, std::size_t dstPitch, std::size_t width, std::size_t height);
+
+    /**
+     * Gets the 4:4:4 YCbCr row converter for a pixel format using the detected instruction set level.
+     *
+     * @param fmt The format of the source pixels
+     *
+     * @return The converter, or nullptr if fmt isn't a 16-bit format
+     */
+    YUVRowConverter YUV444Converter(retro_pixel_format fmt);
+
+    /**
+     * Gets the 4:4:4 YCbCr row converter for a pixel format at a specific instruction set level.
+     *
+     * @param fmt The format of the source pixels
+     * @param level The instruction set to use. Must be supported by the running CPU.
+     *
+     * @return The converter, or nullptr if fmt isn't a 16-bit format
+     */
+    YUVRowConverter YUV444Converter(retro_pixel_format fmt, kSimdLevel level);
+
+    /**
+     * Converts a whole frame into three full resolution planes (Y, Cb, Cr), ready for
+     * tjCompressFromYUVPlanes with TJSAMP_444.
+     *
+     * @param convert The row converter to use
+     * @param src First pixel of the source frame
+     * @param srcPitch Bytes between the start of two source rows
+     * @param planes Y, Cb and Cr plane pointers
+     * @param planePitch Bytes between the start of two rows in each plane
+     * @param width Width in pixels
+     * @param height Height in pixels
+     */
+    void ConvertFrameToYUV444(YUVRowConverter convert, const std::uint8_t *src, std::size_t srcPitch,
+                              std::uint8_t *const planes[3], std::size_t planePitch,
+                              std::size_t width, std::size_t height);
+
+    /**
+     * Shrinks an image by an integer factor by averaging every factor x factor block (box filter). Works on any
+     * interleaved 8-bit layout, e.g. one Y/Cb/Cr plane (channels = 1) or XRGB8888 (channels = 4).
+     *
+     * @param src First byte of the source image, which must be at least dstWidth * factor by dstHeight * factor
+     * @param srcPitch Bytes between the start of two source rows
+     * @param dst First byte of the destination image
+     * @param dstPitch Bytes between the start of two destination rows
+     * @param dstWidth Width of the destination in pixels
+     * @param dstHeight Height of the destination in pixels
+     * @param channels Bytes per pixel
+     * @param factor How much smaller the destination is in each direction
+     */
+    void BoxDownscale(const std::uint8_t *src, std::size_t srcPitch, std::uint8_t *dst, std::size_t dstPitch,
+                      std::size_t dstWidth, std::size_t dstHeight, std::size_t channels, unsigned factor);
+
+    /**
+     * BoxDownscale with the kernels for a specific SIMD level, for comparing kernels against each other
+     */
+    void BoxDownscale(const std::uint8_t *src, std::size_t srcPitch, std::uint8_t *dst, std::size_t dstPitch,
+                      std::size_t dstWidth, std::size_t dstHeight, std::size_t channels, unsigned factor,
+                      kSimdLevel level);
+}
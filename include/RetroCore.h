@@ -10,8 +10,8 @@
 #include <iostream>
 #include <type_traits>
 
+#include <boost/filesystem.hpp>
 #include <boost/function.hpp>
-#include <boost/dll/import.hpp>
 
 #include "libretro.h"
 
@@ -20,6 +20,11 @@
  *
  * Class that loads libretro dynamic library functions into memory.
  *
+ * Cores keep their state in globals, so every instance needs its own copy of the library. Each one is loaded into a
+ * fresh linker namespace with dlmopen, which maps the same file again with its own data but shares the read-only
+ * pages. glibc only has a handful of namespaces; once they run out, the core is loaded from a private copy of the
+ * file instead, named after its md5 and kept around so later loads don't have to copy it again.
+ *
  * @todo Make this cross platform.
  */
 class RetroCore {
@@ -59,8 +64,11 @@ class RetroCore {
     // TODO: On release, use constructor as intended with RAII
     /**
      * Initialize the RetroCore object.
+     *
+     * @param corePath The core to load
+     * @param copyDirectory Where to keep the private copies of the core if dlmopen can't be used
      */
-    void Load(const char *corePath);
+    void Load(const char *corePath, const boost::filesystem::path &copyDirectory = {});
 
     /**
      * Properly shuts down the retro core by calling deinit and similar.
@@ -72,5 +80,22 @@ private:
 	/**
 	 * Will be true if the core was loaded properly
 	 */
-	bool loaded_;
+	bool loaded_{false};
+
+    /**
+     * dlopen handle of the core
+     */
+    void *handle_{nullptr};
+
+    /**
+     * The private copy this instance uses, if any
+     */
+    boost::filesystem::path copy_;
+
+    /**
+     * Loads a private copy of the core, making it first if there's no unused one yet
+     *
+     * @return dlopen handle, nullptr on failure
+     */
+    void *loadCopy(const char *corePath, const boost::filesystem::path &copyDirectory);
 };
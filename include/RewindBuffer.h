@@ -0,0 +1,102 @@
+/**
+ * @file RewindBuffer.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  In-memory history of save states for rewinding an emulator.
+ */
+
+class RewindBuffer;
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * @class RewindBuffer
+ *
+ * Keeps the newest captured state as is, and every older one as the difference to the state captured after it.
+ * Consecutive states of a running game differ in a small part of their bytes, so the difference (the XOR of the two)
+ * is mostly zeros and is stored run length coded:
+ *
+ *  repeated until the end of the state: varint zero bytes to skip, varint n, n bytes to XOR in
+ *
+ * Going back one state is then a single pass over a small delta. The oldest deltas are dropped once the buffer
+ * goes over its memory limit.
+ *
+ * @note Not thread-safe, used by the emulator's own thread
+ */
+class RewindBuffer {
+  public:
+    /**
+     * Fewest equal bytes that end a run of changed bytes. Shorter gaps are cheaper to store as part of the run.
+     */
+    static constexpr std::size_t kMinZeroRun = 8;
+
+    /**
+     * Sets how much memory the deltas may use, dropping the oldest ones if they already use more
+     *
+     * @param maxBytes Limit for the deltas, not counting the newest state itself
+     */
+    void Configure(std::size_t maxBytes);
+
+    /**
+     * Adds a state as the newest one
+     *
+     * @param state The serialized state
+     * @param size Size of state. If it's not the size of the previous state, the history is started over.
+     */
+    void Push(const unsigned char *state, std::size_t size);
+
+    /**
+     * Goes back in the history. The states after the one returned are forgotten, so the next Push continues from it.
+     *
+     * @param steps How many captures to go back, 0 for the newest one. Clamped to the oldest one kept.
+     * @param out Where to put the state
+     *
+     * @return How many captures were actually gone back
+     */
+    std::size_t Rewind(std::size_t steps, std::vector<unsigned char> &out);
+
+    /**
+     * Forgets everything
+     */
+    void Clear();
+
+    /**
+     * Number of states that can be gone back to, not counting the newest one
+     */
+    std::size_t Depth() const { return m_Deltas.size(); }
+
+    /**
+     * Bytes used by the deltas
+     */
+    std::size_t MemoryUsage() const { return m_Bytes; }
+
+  private:
+    /**
+     * Appends the run length coded XOR of a and b to out
+     */
+    static void encodeDelta(const unsigned char *a, const unsigned char *b, std::size_t size, std::string &out);
+
+    /**
+     * XORs a delta from encodeDelta into state
+     */
+    static void applyDelta(const std::string &delta, unsigned char *state, std::size_t size);
+
+    /**
+     * Newest state
+     */
+    std::vector<unsigned char> m_Newest;
+
+    /**
+     * Deltas to the older states, oldest first. Applying the last one to m_Newest gives the state before it.
+     */
+    std::deque<std::string> m_Deltas;
+
+    std::size_t m_Bytes{0}, m_MaxBytes{0};
+};
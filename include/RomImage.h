@@ -0,0 +1,93 @@
+/**
+ * @file RomImage.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Rom contents ready to be handed to a core, decompressed if the rom is an archive.
+ */
+
+class RomImage;
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "MappedFile.h"
+
+/**
+ * @class RomImage
+ *
+ * Plain roms are mapped as they are. zip (stored or deflated, first file in the archive), gzip and, if built with
+ * zstd, zstd roms are decompressed as a stream: into anonymous memory for cores that take the rom as data, or into a
+ * file in the extract directory (meant to be a tmpfs) for cores that need a path. Nothing is written next to the
+ * archive.
+ *
+ * Decompressed roms are keyed by their content (the CRC-32 and size zip and gzip store, the file itself for zstd).
+ * Everyone loading the same content at the same time shares one image, and files extracted for need_fullpath cores
+ * are kept and reused.
+ *
+ * @note Load is thread-safe, images are immutable
+ */
+class RomImage {
+  public:
+    RomImage() = default;
+    RomImage(const RomImage &) = delete;
+    RomImage &operator=(const RomImage &) = delete;
+    ~RomImage();
+
+    /**
+     * Loads a rom
+     *
+     * @param path The rom or archive
+     * @param needFullpath Whether the core reads the rom from a path itself (retro_system_info::need_fullpath)
+     * @param extractDirectory Where archives are extracted to for cores that need a path
+     * @param[out] error What went wrong, if anything
+     *
+     * @return nullptr on failure
+     */
+    static std::shared_ptr<const RomImage> Load(const boost::filesystem::path &path, bool needFullpath,
+                                                const boost::filesystem::path &extractDirectory, std::string &error);
+
+    /**
+     * The rom contents, nullptr for need_fullpath cores
+     */
+    const std::uint8_t *Data() const { return m_data; }
+
+    std::size_t Size() const { return m_size; }
+
+    /**
+     * Path to give the core. The rom itself, the extracted file, or archive#inner name for an archive loaded as data.
+     */
+    const std::string &Path() const { return m_path; }
+
+  private:
+    /**
+     * The archive or plain rom, mapped. Stored zip entries point straight into it.
+     */
+    std::shared_ptr<const MappedFile> m_file;
+
+    /**
+     * Anonymous mapping holding the decompressed rom, if any
+     */
+    std::uint8_t *m_buffer{nullptr};
+    std::size_t m_bufferCapacity{0};
+
+    const std::uint8_t *m_data{nullptr};
+    std::size_t m_size{0};
+    std::string m_path;
+
+    /**
+     * Appends decompressed data to m_buffer, growing it as needed
+     */
+    bool append(const std::uint8_t *data, std::size_t size);
+
+    /**
+     * Makes m_buffer at least capacity bytes big
+     */
+    bool reserve(std::size_t capacity);
+};
@@ -0,0 +1,215 @@
+/**
+ * @file SessionRecorder.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Records the jpegs an emulator streams into a segmented MJPEG archive, and reads such archives back.
+ */
+
+class SessionRecorder;
+class RecordingReader;
+struct RecordingIndexEntry;
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "MappedFile.h"
+
+/**
+ * @struct RecordingIndexEntry
+ *
+ * One frame in a segment index (native byte order). The index of a segment that wasn't closed properly ends in
+ * zeroed entries, so an entry with size 0 marks the end.
+ */
+struct RecordingIndexEntry {
+    /**
+     * When the frame was recorded, in ms since the unix epoch
+     */
+    std::uint64_t time;
+
+    /**
+     * Where the jpeg starts in the segment
+     */
+    std::uint64_t offset;
+
+    /**
+     * Size of the jpeg in bytes
+     */
+    std::uint32_t size;
+
+    /**
+     * Always 0 for now
+     */
+    std::uint32_t flags;
+};
+
+static_assert(sizeof(RecordingIndexEntry) == 24, "RecordingIndexEntry is written to disk as-is");
+
+/**
+ * @class SessionRecorder
+ *
+ * Appends already encoded jpegs to a recording session. A session is a directory of numbered segments: NNNNNN.mjpg
+ * holds the jpegs back to back (so it plays as a plain MJPEG stream) and NNNNNN.idx holds a RecordingIndexEntry per
+ * jpeg. Both are written through MappedFile and a new segment is started once either one is full.
+ *
+ * @note Not thread-safe, owned by whoever sends the frames of one emulator
+ */
+class SessionRecorder {
+  public:
+    ~SessionRecorder();
+
+    /**
+     * Starts a new session in a directory named after the current (UTC) time
+     *
+     * @param directory Where session directories go
+     * @param segmentSize Bytes of jpeg data per segment
+     *
+     * @return false if the session couldn't be created
+     */
+    bool Start(const boost::filesystem::path &directory, std::size_t segmentSize);
+
+    /**
+     * Closes the current segment and ends the session
+     */
+    void Stop();
+
+    /**
+     * Whether or not a session is running
+     */
+    bool IsRecording() const { return m_recording; }
+
+    /**
+     * Adds a jpeg to the session
+     *
+     * @param data The jpeg
+     * @param size Size of the jpeg
+     * @param time When the frame was shown, in ms since the unix epoch
+     *
+     * @return false if it couldn't be written (too big for a segment, or a new segment couldn't be created)
+     */
+    bool Append(const std::uint8_t *data, std::size_t size, std::uint64_t time);
+
+    /**
+     * Directory of the current session
+     */
+    const boost::filesystem::path &Session() const { return m_session; }
+
+  private:
+    /**
+     * Closes the current segment (if any) and creates the next one
+     */
+    bool nextSegment();
+
+    boost::filesystem::path m_session;
+    std::size_t m_segmentSize{0};
+
+    /**
+     * Number of the current segment
+     */
+    std::uint32_t m_segment{0};
+
+    /**
+     * jpeg data and index of the current segment
+     */
+    MappedFile m_data, m_index;
+
+    bool m_recording{false};
+};
+
+/**
+ * @class RecordingReader
+ *
+ * Reads a recording session, including one that's still being recorded (frames added after Open aren't seen).
+ * The indexes of every segment are loaded up front so seeking is a binary search, segments are mapped when a
+ * frame in them is first read.
+ *
+ * @note Not thread-safe
+ */
+class RecordingReader {
+  public:
+    /**
+     * Loads the indexes of a session
+     *
+     * @return false if the session has no readable frames
+     */
+    bool Open(const boost::filesystem::path &session);
+
+    /**
+     * Number of frames in the session
+     */
+    std::size_t FrameCount() const { return m_frames.size(); }
+
+    /**
+     * Time of the first and last frame, in ms since the unix epoch
+     */
+    std::uint64_t StartTime() const;
+    std::uint64_t EndTime() const;
+
+    /**
+     * Time of a frame, in ms since the unix epoch
+     */
+    std::uint64_t FrameTime(std::size_t frame) const { return m_frames[frame].time; }
+
+    /**
+     * Finds the frame that was on screen at a given time
+     *
+     * @param time ms since the unix epoch
+     *
+     * @return The last frame recorded at or before time (the first frame if time is before the session)
+     */
+    std::size_t Seek(std::uint64_t time) const;
+
+    /**
+     * Gets a view of a jpeg, valid until the reader is closed or destroyed
+     *
+     * @return false if the segment holding it couldn't be mapped
+     */
+    bool ReadFrame(std::size_t frame, const std::uint8_t *&data, std::size_t &size);
+
+    /**
+     * Writes the frames shown between two times to one MJPEG file
+     *
+     * @param from Start time, ms since the unix epoch
+     * @param to End time, ms since the unix epoch
+     * @param out File to write
+     *
+     * @return Number of frames written, 0 if nothing was (or the file couldn't be written)
+     */
+    std::size_t Export(std::uint64_t from, std::uint64_t to, const boost::filesystem::path &out);
+
+  private:
+    /**
+     * @struct FrameRef
+     *
+     * Where a frame is in the session
+     */
+    struct FrameRef {
+        std::uint64_t time;
+        std::uint64_t offset;
+        std::uint32_t size;
+        std::uint32_t segment;
+    };
+
+    boost::filesystem::path m_session;
+
+    /**
+     * Every frame in the session, in recording order
+     */
+    std::vector<FrameRef> m_frames;
+
+    /**
+     * Segment files, mapped on first use
+     */
+    std::vector<MappedFile> m_segments;
+
+    /**
+     * Segment numbers, in the same order as m_segments
+     */
+    std::vector<std::uint32_t> m_segmentNumbers;
+};
@@ -0,0 +1,88 @@
+/**
+ * @file SharedMessagePool.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Pool of refcounted websocket++ messages that are framed once and then shared between connections.
+ */
+
+class SharedMessagePool;
+
+#pragma once
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#ifndef _WEBSOCKETPP_CPP11_THREAD_
+#define _WEBSOCKETPP_CPP11_THREAD_
+#endif
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/frame.hpp>
+#include <websocketpp/server.hpp>
+
+/**
+ * @class SharedMessagePool
+ *
+ * Hands out websocket++ messages that can be sent to any number of connections without being copied or
+ * re-framed per connection. A message is only handed out again once every connection it was queued on has
+ * finished writing it (i.e. the pool holds the only reference), so its payload buffer gets reused instead
+ * of being reallocated every frame.
+ *
+ * @note thread-safe
+ */
+class SharedMessagePool {
+  public:
+    /**
+     * The message type used by the server
+     */
+    using message_ptr = websocketpp::server<websocketpp::config::asio>::message_ptr;
+
+    /**
+     * @param maxPooled How many messages to keep around. If every pooled message is still in flight, Acquire
+     * falls back to handing out unpooled messages.
+     */
+    explicit SharedMessagePool(std::size_t maxPooled = 32);
+
+    /**
+     * Get a message that no connection is using anymore.
+     *
+     * @param op The opcode the message will be sent with
+     *
+     * @return A message with an empty payload (that still has its old capacity)
+     */
+    message_ptr Acquire(websocketpp::frame::opcode::value op);
+
+    /**
+     * Writes the frame header for a finished payload and marks the message as prepared, so websocket++
+     * sends it as-is. Server to client frames are never masked, so the same bytes are valid for every
+     * hybi (RFC6455) connection.
+     *
+     * @param msg The message to prepare. Its payload must not be modified afterwards.
+     */
+    static void Prepare(const message_ptr &msg);
+
+    /**
+     * Whether or not a connection can be sent prepared messages
+     *
+     * @param version Value of connection::get_version()
+     */
+    static bool CanSendPrepared(int version);
+
+  private:
+    /**
+     * Messages owned by the pool
+     */
+    std::vector<message_ptr> m_Messages;
+
+    /**
+     * Max size of m_Messages
+     */
+    std::size_t m_MaxPooled;
+
+    /**
+     * Mutex for accessing m_Messages
+     */
+    std::mutex m_Mutex;
+};
@@ -0,0 +1,24 @@
+/**
+ * @file Simd.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Macros shared by the files that have SIMD kernels.
+ */
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define LP_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/*
+ * The kernels are compiled with per-function target attributes so that the AVX2 kernels can be shipped
+ * in the same binary as the SSSE3 ones and only be used when the CPU says it's safe to.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define LP_TARGET(isa) __attribute__((target(isa)))
+#else
+#define LP_TARGET(isa)
+#endif
@@ -0,0 +1,142 @@
+/**
+ * @file StateWriter.h
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Background thread that writes save states and backups to disk, or does any other slow disk work.
+ */
+
+class StateWriter;
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "Logging.hpp"
+
+/**
+ * @class StateWriter
+ *
+ * The emulator thread serializes into a buffer from Acquire and hands it to Save, everything that touches the disk
+ * (rotating current.state into the history, writing, pruning) happens on the writer's own thread. Jobs run one at a
+ * time in the order they were queued, so something queued with Post after a Save sees that state on disk.
+ *
+ * current.state is replaced atomically: the new state is written to a temporary file and synced, the old one is
+ * hard linked into the history and only then is the temporary renamed over it. A crash at any point leaves a
+ * complete current.state behind.
+ *
+ * @note Acquire, Save and Post are thread-safe
+ */
+class StateWriter {
+  public:
+    /**
+     * Free buffers kept around for the next save
+     */
+    static constexpr std::size_t kMaxPooledBuffers = 2;
+
+    ~StateWriter();
+
+    /**
+     * Starts the writer thread
+     *
+     * @param historyDirectory Where current.state and the older states go
+     * @param logger Where to report failures
+     * @param name Prefix for log messages, usually the emulator id
+     */
+    void Start(const boost::filesystem::path &historyDirectory, Logger &logger, const std::string &name);
+
+    /**
+     * Finishes the queued jobs and joins the writer thread
+     */
+    void Stop();
+
+    /**
+     * Gets a buffer to serialize a state into, reusing one from an earlier save if possible
+     *
+     * @param size Size of the state
+     */
+    std::vector<unsigned char> Acquire(std::size_t size);
+
+    /**
+     * Queues a state to become the new current.state
+     *
+     * @param state The state, from Acquire. Goes back to the pool once written.
+     * @param maxHistorySize How many older states to keep in the history
+     */
+    void Save(std::vector<unsigned char> &&state, std::uint64_t maxHistorySize);
+
+    /**
+     * Queues any other disk work behind what's already queued
+     */
+    void Post(std::function<void()> job);
+
+  private:
+    /**
+     * @struct Job
+     *
+     * Either a state to save or a task from Post
+     */
+    struct Job {
+        std::vector<unsigned char> state;
+        std::uint64_t maxHistorySize{0};
+        std::function<void()> task;
+    };
+
+    /**
+     * Writer thread loop
+     */
+    void work();
+
+    /**
+     * Makes state the new current.state, moving the previous one into the history
+     *
+     * @return false if writing failed, current.state is left untouched then
+     */
+    bool persist(const std::vector<unsigned char> &state);
+
+    /**
+     * Deletes the oldest history states until there are at most maxHistorySize left
+     */
+    void prune(std::uint64_t maxHistorySize);
+
+    boost::filesystem::path m_Directory;
+    Logger *m_Logger{nullptr};
+    std::string m_Name;
+
+    /**
+     * Queued jobs, oldest first
+     */
+    std::deque<Job> m_Jobs;
+
+    /**
+     * Buffers of written states, ready to be handed out again
+     */
+    std::vector<std::vector<unsigned char>> m_Free;
+
+    /**
+     * Mutex for m_Jobs, m_Free and m_Running
+     */
+    std::mutex m_Mutex;
+
+    /**
+     * Wakes up the writer when a job is queued
+     */
+    std::condition_variable m_Notifier;
+
+    /**
+     * If true, the writer keeps waiting for jobs
+     */
+    bool m_Running{false};
+
+    std::thread m_Thread;
+};
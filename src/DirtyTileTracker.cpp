@@ -0,0 +1,103 @@
+#include "DirtyTileTracker.h"
+
+#include <algorithm>
+#include <cstring>
+
+bool DirtyTileTracker::Update(const Frame &frame) {
+    const std::size_t bpp = PixelConversion::BytesPerPixel(frame.format);
+    const std::size_t rowSize = frame.width * bpp;
+
+    const bool comparable = !m_previous.empty() && frame.width == m_width && frame.height == m_height &&
+                            frame.format == m_format;
+
+    if (!comparable) {
+        m_width = frame.width;
+        m_height = frame.height;
+        m_format = frame.format;
+        m_tilesX = (m_width + kTileSize - 1) / kTileSize;
+        m_tilesY = (m_height + kTileSize - 1) / kTileSize;
+        m_previous.resize(rowSize * m_height);
+    }
+
+    m_dirty.assign(std::size_t(m_tilesX) * m_tilesY, comparable ? 0 : 1);
+    m_dirtyCount = comparable ? 0 : m_dirty.size();
+
+    for (std::uint32_t y = 0; y < m_height; ++y) {
+        const std::uint8_t *src = frame.data + std::size_t(y) * frame.pitch;
+        std::uint8_t *prev = m_previous.data() + y * rowSize;
+
+        if (comparable) {
+            std::uint8_t *dirtyRow = &m_dirty[(y / kTileSize) * m_tilesX];
+            for (std::uint32_t tx = 0; tx < m_tilesX; ++tx) {
+                if (dirtyRow[tx])
+                    continue;
+
+                const std::size_t offset = tx * kTileSize * bpp;
+                const std::size_t span = std::min<std::size_t>(kTileSize * bpp, rowSize - offset);
+                if (std::memcmp(src + offset, prev + offset, span) != 0) {
+                    dirtyRow[tx] = 1;
+                    ++m_dirtyCount;
+                }
+            }
+        }
+
+        std::memcpy(prev, src, rowSize);
+    }
+
+    return comparable;
+}
+
+void DirtyTileTracker::Reset() {
+    m_previous.clear();
+    m_dirty.clear();
+    m_dirtyCount = 0;
+}
+
+std::vector<TileRect> DirtyTileTracker::DirtyRects() const {
+    std::vector<TileRect> rects;
+
+    // Rects that ended on the previous tile row, candidates for growing downwards
+    std::vector<std::size_t> open, stillOpen;
+
+    for (std::uint32_t ty = 0; ty < m_tilesY; ++ty) {
+        stillOpen.clear();
+        const std::uint8_t *dirtyRow = &m_dirty[ty * m_tilesX];
+
+        for (std::uint32_t tx = 0; tx < m_tilesX; ++tx) {
+            if (!dirtyRow[tx])
+                continue;
+
+            // Horizontal run of dirty tiles
+            std::uint32_t end = tx;
+            while (end < m_tilesX && dirtyRow[end])
+                ++end;
+
+            const std::uint32_t x = tx * kTileSize, y = ty * kTileSize;
+            const std::uint32_t width = std::min(end * kTileSize, m_width) - x;
+            const std::uint32_t height = std::min(y + kTileSize, m_height) - y;
+
+            // Same span as a rect directly above it: extend that one instead
+            auto above = std::find_if(open.begin(), open.end(), [&](std::size_t i) {
+                return rects[i].x == x && rects[i].width == width;
+            });
+
+            if (above != open.end()) {
+                rects[*above].height += height;
+                stillOpen.push_back(*above);
+            } else {
+                rects.push_back(TileRect{x, y, width, height});
+                stillOpen.push_back(rects.size() - 1);
+            }
+
+            tx = end;
+        }
+
+        std::swap(open, stillOpen);
+    }
+
+    return rects;
+}
+
+double DirtyTileTracker::DirtyFraction() const {
+    return m_dirty.empty() ? 1.0 : double(m_dirtyCount) / m_dirty.size();
+}
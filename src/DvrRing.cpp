@@ -0,0 +1,57 @@
+#include "DvrRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+void DvrRing::Configure(std::size_t capacity, std::uint64_t maxAge) {
+    m_index.clear();
+    m_head = 0;
+    m_maxAge = maxAge;
+
+    if (capacity != m_buffer.size())
+        std::vector<std::uint8_t>(capacity).swap(m_buffer);
+}
+
+bool DvrRing::Append(const std::uint8_t *data, std::size_t size, std::uint64_t time) {
+    if (size == 0 || size > m_buffer.size())
+        return false;
+
+    // Out of time
+    while (!m_index.empty() && m_index.front().time + m_maxAge < time)
+        m_index.pop_front();
+
+    /* The oldest frames are the ones right after the head. Wrapping skips over everything from the head to the end,
+     * and the frames that were there are dropped along with the ones that get overwritten at the start. */
+    std::size_t offset = m_head;
+    if (offset + size > m_buffer.size()) {
+        while (!m_index.empty() && m_index.front().offset >= m_head)
+            m_index.pop_front();
+        offset = 0;
+    }
+
+    while (!m_index.empty() && m_index.front().offset >= offset && m_index.front().offset < offset + size)
+        m_index.pop_front();
+
+    std::memcpy(m_buffer.data() + offset, data, size);
+    m_index.push_back(DvrEntry{++m_sequence, time, offset, size});
+    m_head = offset + size;
+    return true;
+}
+
+bool DvrRing::Find(std::uint64_t time, DvrEntry &entry) const {
+    if (m_index.empty())
+        return false;
+
+    auto after = std::upper_bound(m_index.begin(), m_index.end(), time,
+                                  [](std::uint64_t t, const DvrEntry &e) { return t < e.time; });
+    entry = after == m_index.begin() ? *after : *(after - 1);
+    return true;
+}
+
+bool DvrRing::Newest(DvrEntry &entry) const {
+    if (m_index.empty())
+        return false;
+
+    entry = m_index.back();
+    return true;
+}
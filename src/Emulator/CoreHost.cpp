@@ -0,0 +1,268 @@
+#include "CoreHost.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "PixelConversion.h"
+
+extern char **environ;
+
+constexpr std::uint32_t CoreHostShared::kMagic;
+constexpr std::size_t CoreHostShared::kPathSize;
+constexpr std::size_t CoreHostShared::kFrameSlots;
+constexpr std::size_t CoreHostShared::kMaxFrameBytes;
+constexpr std::size_t CoreHostShared::kMaxStateBytes;
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t) && ATOMIC_INT_LOCK_FREE == 2,
+              "The request/response words have to be plain lock-free 32-bit words to be shared with the child");
+
+namespace {
+    void copyString(char *to, const std::string &from, std::size_t size) {
+        std::strncpy(to, from.c_str(), size - 1);
+        to[size - 1] = '\0';
+    }
+}
+
+CoreHost::~CoreHost() {
+    Stop();
+
+    if (m_Shared)
+        ::munmap(m_Shared, CoreHostShared::TotalSize());
+    if (m_Fd >= 0)
+        ::close(m_Fd);
+}
+
+void CoreHost::futexWait(std::atomic<std::uint32_t> &word, std::uint32_t expected,
+                         std::chrono::milliseconds timeout) {
+    timespec ts{};
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1'000'000;
+
+    // Not FUTEX_PRIVATE_FLAG, the word is shared with another process
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+void CoreHost::futexWake(std::atomic<std::uint32_t> &word) {
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+bool CoreHost::Start(const Options &options, Logger &logger, const std::string &name) {
+    kill();
+    m_Options = options;
+    m_Logger = &logger;
+    m_Name = name;
+
+    if (m_Fd < 0) {
+        m_Fd = ::memfd_create("letsplay-core", MFD_CLOEXEC);
+        if (m_Fd < 0 || ::ftruncate(m_Fd, CoreHostShared::TotalSize()) != 0) {
+            m_Logger->err(m_Name, ": Failed to create the shared memory for the core host: ", std::strerror(errno));
+            return false;
+        }
+
+        void *memory = ::mmap(nullptr, CoreHostShared::TotalSize(), PROT_READ | PROT_WRITE, MAP_SHARED, m_Fd, 0);
+        if (memory == MAP_FAILED) {
+            m_Logger->err(m_Name, ": Failed to map the shared memory for the core host: ", std::strerror(errno));
+            return false;
+        }
+        m_Shared = static_cast<CoreHostShared *>(memory);
+    }
+
+    // Start from a clean slate, a restarted child shouldn't see what the previous one left behind
+    std::memset(static_cast<void *>(m_Shared), 0, sizeof(CoreHostShared));
+    m_Shared->magic = CoreHostShared::kMagic;
+    copyString(m_Shared->corePath, options.corePath, CoreHostShared::kPathSize);
+    copyString(m_Shared->romPath, options.romPath, CoreHostShared::kPathSize);
+    copyString(m_Shared->extractDirectory, options.extractDirectory, CoreHostShared::kPathSize);
+    copyString(m_Shared->systemDirectory, options.systemDirectory, CoreHostShared::kPathSize);
+    copyString(m_Shared->saveDirectory, options.saveDirectory, CoreHostShared::kPathSize);
+    copyString(m_Shared->username, options.username, sizeof(m_Shared->username));
+    m_LastFrame = m_LastAvinfo = 0;
+
+    // The memfd is close-on-exec so other emulators' children don't get it, dup2 gives this child its own copy
+    const int childFd = (m_Fd == 3) ? 4 : 3;
+    const std::string fdArgument = std::to_string(childFd);
+    char arg0[] = "letsplay-core-host", arg1[] = "--core-host";
+    char *argv[] = {arg0, arg1, const_cast<char *>(fdArgument.c_str()), nullptr};
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, m_Fd, childFd);
+
+    const int error = ::posix_spawn(&m_Pid, "/proc/self/exe", &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        m_Logger->err(m_Name, ": Failed to start the core host: ", std::strerror(error));
+        m_Pid = -1;
+        return false;
+    }
+
+    return call(kCoreHostCommand::Init, std::max(m_Options.stallTimeout, std::chrono::milliseconds(30000)));
+}
+
+void CoreHost::Stop() {
+    if (!Alive())
+        return;
+
+    call(kCoreHostCommand::Quit, std::chrono::milliseconds(1000));
+    kill();
+}
+
+void CoreHost::kill() {
+    if (m_Pid <= 0)
+        return;
+
+    ::kill(m_Pid, SIGKILL);
+    while (::waitpid(m_Pid, nullptr, 0) < 0 && errno == EINTR) {}
+    m_Pid = -1;
+}
+
+bool CoreHost::call(kCoreHostCommand command, std::chrono::milliseconds timeout) {
+    if (!Alive())
+        return false;
+
+    m_Shared->command = command;
+    const auto request = m_Shared->request.load(std::memory_order_relaxed) + 1;
+    m_Shared->request.store(request, std::memory_order_release);
+    futexWake(m_Shared->request);
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (;;) {
+        // Waiting on the value that was checked means an answer that lands in between makes the futex return
+        // straight away instead of sleeping out the slice
+        const auto response = m_Shared->response.load(std::memory_order_acquire);
+        if (response == request)
+            break;
+
+        // Wake up now and then to see if the child is still there
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            m_Logger->err(m_Name, ": Core host ", m_Pid, " stalled, killing it.");
+            kill();
+            return false;
+        }
+
+        int status;
+        if (::waitpid(m_Pid, &status, WNOHANG) == m_Pid) {
+            if (command != kCoreHostCommand::Quit)
+                m_Logger->err(m_Name, ": Core host ", m_Pid, " died (",
+                              WIFSIGNALED(status) ? "signal " + std::to_string(WTERMSIG(status))
+                                                  : "exit " + std::to_string(WEXITSTATUS(status)), ").");
+            m_Pid = -1;
+            return false;
+        }
+
+        const auto slice = std::min<std::chrono::milliseconds>(
+                std::chrono::milliseconds(100),
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1));
+        futexWait(m_Shared->response, response, slice);
+    }
+
+    return m_Shared->result != 0;
+}
+
+bool CoreHost::Run(RetroPad &joypad, int audioVideoEnable, std::int64_t frameTime) {
+    if (!Alive())
+        return false;
+
+    std::uint16_t buttons = 0;
+    for (unsigned i = 0; i < 16; ++i)
+        buttons |= static_cast<std::uint16_t>(joypad.isPressed(i) ? 1u << i : 0u);
+
+    m_Shared->buttons = buttons;
+    for (unsigned index = 0; index < 2; ++index)
+        for (unsigned axis = 0; axis < 2; ++axis)
+            m_Shared->analog[index][axis] = joypad.analogValue(index, axis);
+
+    m_Shared->audioVideoEnable = audioVideoEnable;
+    m_Shared->frameTime = frameTime;
+
+    return call(kCoreHostCommand::Run, m_Options.stallTimeout);
+}
+
+std::size_t CoreHost::SaveStateSize() {
+    if (!call(kCoreHostCommand::StateSize, m_Options.stallTimeout))
+        return 0;
+
+    // Callers allocate this much, and a state that big couldn't go through the state area anyway
+    const std::uint64_t size = m_Shared->stateSize;
+    if (size > CoreHostShared::kMaxStateBytes) {
+        m_Logger->err(m_Name, ": Core host ", m_Pid, " reported a ", size, " byte state, more than the ",
+                      CoreHostShared::kMaxStateBytes, " that fit. Killing it.");
+        kill();
+        return 0;
+    }
+
+    return static_cast<std::size_t>(size);
+}
+
+bool CoreHost::SaveState(void *data, std::size_t size) {
+    if (size > CoreHostShared::kMaxStateBytes)
+        return false;
+
+    m_Shared->stateSize = size;
+    if (!call(kCoreHostCommand::SaveState, m_Options.stallTimeout))
+        return false;
+
+    std::memcpy(data, reinterpret_cast<const std::uint8_t *>(m_Shared) + CoreHostShared::StateOffset(), size);
+    return true;
+}
+
+bool CoreHost::LoadState(const void *data, std::size_t size) {
+    if (!Alive() || size > CoreHostShared::kMaxStateBytes)
+        return false;
+
+    std::memcpy(reinterpret_cast<std::uint8_t *>(m_Shared) + CoreHostShared::StateOffset(), data, size);
+    m_Shared->stateSize = size;
+    return call(kCoreHostCommand::LoadState, m_Options.stallTimeout);
+}
+
+void CoreHost::GetAudioVideoInfo(retro_system_av_info &info) const {
+    if (m_Shared)
+        info = m_Shared->avinfo;
+}
+
+bool CoreHost::TakeFrame(Frame &frame) {
+    if (!Alive() || m_Shared->frameSequence == m_LastFrame)
+        return false;
+
+    m_LastFrame = m_Shared->frameSequence;
+
+    // Read once and checked, the child is the one we don't trust to stay inside the shared memory
+    const std::uint32_t slot = m_Shared->frameSlot, width = m_Shared->frameWidth, height = m_Shared->frameHeight,
+            pitch = m_Shared->framePitch;
+    const retro_pixel_format format = m_Shared->frameFormat;
+    const bool knownFormat = format == RETRO_PIXEL_FORMAT_0RGB1555 || format == RETRO_PIXEL_FORMAT_XRGB8888 ||
+                             format == RETRO_PIXEL_FORMAT_RGB565;
+    if (slot >= CoreHostShared::kFrameSlots || !knownFormat ||
+        std::uint64_t(pitch) < std::uint64_t(width) * PixelConversion::BytesPerPixel(format) ||
+        std::uint64_t(pitch) * height > CoreHostShared::kMaxFrameBytes) {
+        m_Logger->err(m_Name, ": Core host ", m_Pid, " sent a bad frame (slot ", slot, ", ", width, 'x', height,
+                      ", pitch ", pitch, "), killing it.");
+        kill();
+        return false;
+    }
+
+    frame = Frame{width, height, pitch,
+                  reinterpret_cast<const std::uint8_t *>(m_Shared) + CoreHostShared::FrameOffset(slot), format};
+    return true;
+}
+
+bool CoreHost::TakeAudioVideoInfo(retro_system_av_info &info) {
+    if (!Alive() || m_Shared->avinfoSequence == m_LastAvinfo)
+        return false;
+
+    m_LastAvinfo = m_Shared->avinfoSequence;
+    info = m_Shared->avinfo;
+    return true;
+}
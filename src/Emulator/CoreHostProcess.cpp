@@ -0,0 +1,264 @@
+/**
+ * Child side of CoreHost: a libretro frontend that only knows one core, so it gets by with plain globals. Video goes
+ * into the shared frame slots, input and requests come from the server through the shared memory.
+ */
+#include "CoreHost.h"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "RetroCore.h"
+#include "RomImage.h"
+
+namespace {
+    RetroCore Core;
+
+    CoreHostShared *shared{nullptr};
+
+    retro_pixel_format pixelFormat{RETRO_PIXEL_FORMAT_0RGB1555};
+
+    retro_frame_time_callback frameTimeCallback{nullptr, 0};
+
+    std::shared_ptr<const RomImage> romData;
+
+    std::uint8_t *frameSlot(std::size_t slot) {
+        return reinterpret_cast<std::uint8_t *>(shared) + CoreHostShared::FrameOffset(slot);
+    }
+
+    std::uint8_t *stateArea() {
+        return reinterpret_cast<std::uint8_t *>(shared) + CoreHostShared::StateOffset();
+    }
+
+    /**
+     * Slot the next frame goes into, never the one holding the latest frame
+     */
+    std::size_t nextSlot() {
+        return (shared->frameSlot + 1) % CoreHostShared::kFrameSlots;
+    }
+
+    std::size_t bytesPerPixel(retro_pixel_format format) {
+        return format == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2;
+    }
+
+    bool onEnvironment(unsigned cmd, void *data) {
+        switch (cmd) {
+            case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT: {
+                const auto fmt = *static_cast<const retro_pixel_format *>(data);
+                if (fmt > RETRO_PIXEL_FORMAT_RGB565)
+                    return false;
+
+                pixelFormat = fmt;
+            }
+                break;
+            case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+                *static_cast<const char **>(data) = shared->systemDirectory;
+                break;
+            case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+                *static_cast<const char **>(data) = shared->saveDirectory;
+                break;
+            case RETRO_ENVIRONMENT_GET_USERNAME:
+                *static_cast<const char **>(data) = shared->username;
+                break;
+            case RETRO_ENVIRONMENT_GET_OVERSCAN:
+                return false;
+            case RETRO_ENVIRONMENT_GET_CAN_DUPE:
+                *static_cast<bool *>(data) = true;
+                break;
+            case RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER: {
+                auto *framebuffer = static_cast<retro_framebuffer *>(data);
+
+                const std::size_t pitch = framebuffer->width * bytesPerPixel(pixelFormat);
+                if (pitch * framebuffer->height > CoreHostShared::kMaxFrameBytes)
+                    return false;
+
+                framebuffer->data = frameSlot(nextSlot());
+                framebuffer->pitch = pitch;
+                framebuffer->format = pixelFormat;
+                framebuffer->memory_flags = RETRO_MEMORY_TYPE_CACHED;
+            }
+                break;
+            case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO: {
+                auto *info = static_cast<const retro_system_av_info *>(data);
+                if (!info)
+                    return false;
+
+                shared->avinfo = *info;
+                ++shared->avinfoSequence;
+            }
+                break;
+            case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK: {
+                auto *callback = static_cast<const retro_frame_time_callback *>(data);
+                if (!callback)
+                    return false;
+
+                frameTimeCallback = *callback;
+            }
+                break;
+            case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE:
+                if (!data)
+                    return false;
+
+                *static_cast<int *>(data) = shared->audioVideoEnable;
+                break;
+            default:
+                return false;
+        }
+        return true;
+    }
+
+    void onVideoRefresh(const void *data, unsigned width, unsigned height, size_t pitch) {
+        if (data == nullptr) // Dupe, the latest frame stays the latest
+            return;
+
+        const std::size_t slot = nextSlot();
+        const std::size_t rowBytes = width * bytesPerPixel(pixelFormat);
+        if (rowBytes * height > CoreHostShared::kMaxFrameBytes) {
+            std::cerr << "Core host: dropping a " << width << 'x' << height << " frame, too big for the frame slots\n";
+            return;
+        }
+
+        // Rendered straight into the slot through GET_CURRENT_SOFTWARE_FRAMEBUFFER, nothing to copy
+        if (data != frameSlot(slot)) {
+            auto *to = frameSlot(slot);
+            const auto *from = static_cast<const std::uint8_t *>(data);
+            if (pitch == rowBytes) {
+                std::memcpy(to, from, rowBytes * height);
+            } else {
+                for (unsigned y = 0; y < height; ++y)
+                    std::memcpy(to + y * rowBytes, from + y * pitch, rowBytes);
+            }
+            pitch = rowBytes;
+        }
+
+        shared->frameWidth = width;
+        shared->frameHeight = height;
+        shared->framePitch = static_cast<std::uint32_t>(pitch);
+        shared->frameFormat = pixelFormat;
+        shared->frameSlot = static_cast<std::uint32_t>(slot);
+        ++shared->frameSequence;
+    }
+
+    void onPollInput() {}
+
+    std::int16_t onGetInputState(unsigned port, unsigned device, unsigned index, unsigned id) {
+        if (port != 0)
+            return 0;
+
+        switch (device) {
+            case RETRO_DEVICE_JOYPAD:
+                return id < 16 ? (shared->buttons >> id) & 1 : 0;
+            case RETRO_DEVICE_ANALOG:
+                return (index < 2 && id < 2) ? shared->analog[index][id] : 0;
+            default:
+                return 0;
+        }
+    }
+
+    void onAudioSample(std::int16_t, std::int16_t) {}
+
+    size_t onAudioSampleBatch(const std::int16_t *, size_t frames) {
+        return frames;
+    }
+
+    bool init() {
+        Core.Load(shared->corePath);
+
+        Core.SetEnvironment(onEnvironment);
+        Core.SetVideoRefresh(onVideoRefresh);
+        Core.SetInputPoll(onPollInput);
+        Core.SetInputState(onGetInputState);
+        Core.SetAudioSample(onAudioSample);
+        Core.SetAudioSampleBatch(onAudioSampleBatch);
+        Core.Init();
+
+        // Cores that don't need a rom get an empty path
+        if (shared->romPath[0] != '\0') {
+            retro_system_info system{};
+            Core.GetSystemInfo(&system);
+
+            std::string error;
+            romData = RomImage::Load(shared->romPath, system.need_fullpath, shared->extractDirectory, error);
+            if (!romData) {
+                std::cerr << "Core host: failed to load the rom: " << error << '\n';
+                return false;
+            }
+
+            retro_game_info info{romData->Path().c_str(), romData->Data(), romData->Size(), nullptr};
+
+            if (!Core.LoadGame(&info))
+                return false;
+        }
+
+        Core.GetAudioVideoInfo(&shared->avinfo);
+        ++shared->avinfoSequence;
+        return true;
+    }
+
+    bool handle(kCoreHostCommand command) {
+        switch (command) {
+            case kCoreHostCommand::Init:
+                return init();
+            case kCoreHostCommand::Run:
+                if (frameTimeCallback.callback)
+                    frameTimeCallback.callback(shared->frameTime < 0 ? frameTimeCallback.reference
+                                                                     : shared->frameTime);
+                Core.Run();
+                return true;
+            case kCoreHostCommand::StateSize:
+                shared->stateSize = Core.SaveStateSize();
+                return true;
+            case kCoreHostCommand::SaveState:
+                return Core.SaveState(stateArea(), shared->stateSize);
+            case kCoreHostCommand::LoadState:
+                return Core.LoadState(stateArea(), shared->stateSize);
+            case kCoreHostCommand::Quit:
+                return true;
+        }
+        return false;
+    }
+}
+
+int CoreHost::ChildMain(int fd) {
+    // Go down with the server
+    ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (::getppid() == 1)
+        return 1;
+
+    void *memory = ::mmap(nullptr, CoreHostShared::TotalSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Core host: failed to map the shared memory: " << std::strerror(errno) << '\n';
+        return 1;
+    }
+    ::close(fd);
+
+    shared = static_cast<CoreHostShared *>(memory);
+    if (shared->magic != CoreHostShared::kMagic) {
+        std::cerr << "Core host: bad shared memory\n";
+        return 1;
+    }
+
+    std::uint32_t handled = shared->response.load(std::memory_order_relaxed);
+    while (true) {
+        const auto request = shared->request.load(std::memory_order_acquire);
+        if (request == handled) {
+            futexWait(shared->request, handled, std::chrono::milliseconds(1000));
+            continue;
+        }
+
+        const auto command = shared->command;
+        shared->result = handle(command) ? 1 : 0;
+
+        handled = request;
+        shared->response.store(request, std::memory_order_release);
+        futexWake(shared->response);
+
+        if (command == kCoreHostCommand::Quit)
+            return 0;
+    }
+}
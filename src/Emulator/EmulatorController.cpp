@@ -9,11 +9,9 @@
  * emulators and... well... can't do that if they share the same global state! So, the current solution
  * to that is to run every emulator in its own thread (yikes!), so that they each can get their own state.
  *
- * Something I'm looking into for solving this in a more elegant way is to:
- *      - fork() off and spawn a new process when creating a EmulatorController
- *      - Use TIPC as the IPC protocol for EmulatorControler <-> LetsPlayServer communication
- *          - Why TIPC? Well, just in case I wanted to cluster this and allow my RPI to run a SNES emulator,
- *            while my laptop runs the actual server, because, why not? Also TIPC sounds pretty cool
+ * With isolation.enabled the core itself runs in a child process instead (see CoreHost), which has all of the
+ * libretro globals to itself and can crash or hang without taking the server with it. The thread stays around for
+ * the turns, the work queue and pacing, and drives the child through shared memory.
  */
 namespace EmulatorController {
     /**
@@ -47,7 +45,7 @@ namespace EmulatorController {
     /**
      * Rom data if loaded from file.
      */
-    static thread_local char *romData{nullptr};
+    static thread_local std::shared_ptr<const RomImage> romData;
 
     /**
      * Turn queue for this emulator
@@ -71,19 +69,20 @@ namespace EmulatorController {
     static thread_local VideoFormat videoFormat;
 
     /**
-     * Pointer to the current video buffer.
+     * Copies of the frames the core presents. The core's own buffer is only valid until the next retro_run, so
+     * everything outside of OnVideoRefresh reads from here instead.
      */
-    static thread_local const void *currentBuffer{nullptr};
+    static thread_local FrameMailbox frames;
 
     /**
-     * Mutex for accessing m_screen or m_nextFrame or updating the buffer.
+     * libretro API struct that stores audio-video information.
      */
-    static thread_local std::mutex videoMutex;
+    static thread_local retro_system_av_info avinfo;
 
     /**
-     * libretro API struct that stores audio-video information.
+     * Keeps retro_run being called at avinfo.timing.fps
      */
-    static thread_local retro_system_av_info avinfo;
+    static thread_local FramePacer pacer;
 
     /**
      * libretro logging interface struct (points to server->logger.logFormatted)
@@ -95,6 +94,62 @@ namespace EmulatorController {
      */
     static thread_local std::atomic<bool> fastForward{false};
 
+    /**
+     * How many times retro_run is called per frame while fast forwarded, loaded from config on every toggle
+     */
+    static thread_local unsigned fastForwardSpeed{2};
+
+    /**
+     * Whether or not frames are being recorded, in which case they're sent to the server even if nobody is watching
+     */
+    static thread_local bool recording{false};
+
+    /**
+     * The core's frame time callback, if it set one. Gets the real time between retro_run calls.
+     */
+    static thread_local retro_frame_time_callback frameTimeCallback{nullptr, 0};
+
+    /**
+     * When retro_run was last called, for frameTimeCallback
+     */
+    static thread_local std::chrono::time_point<std::chrono::steady_clock> lastRun;
+
+    /**
+     * What GET_AUDIO_VIDEO_ENABLE answers with for the frame being run. Video is only asked for when the frame is
+     * going to be sent; audio is never asked for since nothing plays it.
+     */
+    static thread_local int audioVideoEnable{1};
+
+    /**
+     * Time since the previous retro_run for the frame being run, < 0 for the core's reference time
+     */
+    static thread_local retro_usec_t frameTime{-1};
+
+    /**
+     * Whether the core runs in a child process (isolation.enabled), in which case Core's functions go to coreHost
+     */
+    static thread_local bool isolated{false};
+
+    /**
+     * The child process running the core if isolated
+     */
+    static thread_local CoreHost coreHost;
+
+    /**
+     * What coreHost was started with, to restart it the same way
+     */
+    static thread_local CoreHost::Options coreHostOptions;
+
+    /**
+     * Restarts of a crashed core are spaced out at least isolation.restartDelay, this is when the next may happen
+     */
+    static thread_local std::chrono::time_point<std::chrono::steady_clock> nextCoreRestart;
+
+    /**
+     * A preview was asked for and has to wait for a frame that the core actually rendered
+     */
+    static thread_local bool previewPending{false};
+
     /**
      * Timepoint of the last fastForward toggle. Used to prevent (over|ab)use.
      */
@@ -120,6 +175,26 @@ namespace EmulatorController {
      */
     static thread_local std::shared_timed_mutex generalMutex;
 
+    /**
+     * Writes save states and backups to disk so the emulator thread doesn't wait on it
+     */
+    static thread_local StateWriter stateWriter;
+
+    /**
+     * Recent states kept in memory for rewinding
+     */
+    static thread_local RewindBuffer rewindBuffer;
+
+    /**
+     * Frames between two rewind captures, 0 if rewinding is off
+     */
+    static thread_local std::uint64_t rewindInterval{0};
+
+    /**
+     * Buffer the rewind states are serialized into
+     */
+    static thread_local std::vector<unsigned char> rewindState;
+
 
     /*
      * --- Work Queue Stuff ---
@@ -211,38 +286,30 @@ void EmulatorController::Run(const std::string& corePath, const std::string& rom
     boost::filesystem::create_directories(dataDirectory / "history");
     boost::filesystem::create_directories(dataDirectory / "backups" / "states");
     boost::filesystem::create_directories(saveDirectory = dataDirectory / "saves");
-
-    t_server->logger.log("Copying core file to own path... (", (dataDirectory / "emulator.so").string(), ')');
-    boost::filesystem::remove((dataDirectory / "emulator.so").string());
-    boost::filesystem::copy_file(coreFile.string(), (dataDirectory / "emulator.so").string());
+    stateWriter.Start(dataDirectory / "history", t_server->logger, t_id);
 
     t_server->logger.log("Starting up ", t_id, "...");
 
-    Core.Load((dataDirectory / "emulator.so").string().c_str());
-
     server = t_server;
     id = t_id;
-    proxy = EmulatorControllerProxy{&workQueue, &queueMutex, &queueNotifier, GetFrame, &joypad, description, &forbiddenCombos};
+    proxy = EmulatorControllerProxy{&workQueue, &queueMutex, &queueNotifier, &frames, &joypad, description, &forbiddenCombos};
 
     server->AddEmu(id, &proxy);
 
-    // Add emu specific config if it doesn't already exist
+    // Add emu specific config if it doesn't already exist, or add settings that were added to the template since
     auto emuConfigs = server->config.get<nlohmann::json>(nlohmann::json::value_t::object, "serverConfig", "emulators");
+    auto emuTemplate = server->config.get<nlohmann::json>(nlohmann::json::value_t::object, "serverConfig", "emulators", "template");
     if(!emuConfigs.count(id)) {
-        auto emuTemplate = server->config.get<nlohmann::json>(nlohmann::json::value_t::object, "serverConfig", "emulators", "template");
         server->config.set("serverConfig", "emulators", id, emuTemplate);
+    } else {
+        for (auto it = emuTemplate.begin(); it != emuTemplate.end(); ++it) {
+            if (!emuConfigs[id].count(it.key()))
+                server->config.set("serverConfig", "emulators", id, it.key(), it.value());
+        }
     }
 
     server->config.SaveConfig();
 
-    Core.SetEnvironment(OnEnvironment);
-    Core.SetVideoRefresh(OnVideoRefresh);
-    Core.SetInputPoll(OnPollInput);
-    Core.SetInputState(OnGetInputState);
-    Core.SetAudioSample(OnLRAudioSample);
-    Core.SetAudioSampleBatch(OnBatchAudioSample);
-    Core.Init();
-
     // Load forbidden button combos into memory
     auto jForbiddenCombos = server->config.get<nlohmann::json>(nlohmann::json::value_t::array, "serverConfig", "emulators", id, "forbiddenCombos");
 
@@ -265,33 +332,47 @@ void EmulatorController::Run(const std::string& corePath, const std::string& rom
             forbiddenCombos.push_back(combo);
     }
 
-    server->logger.log(id, ": Finished initialization.");
+    isolated = server->config.get<bool>(nlohmann::json::value_t::boolean, "serverConfig", "emulators", id, "isolation",
+                                        "enabled");
+    if (isolated) {
+        if (!StartCoreHost(corePath, romPath)) {
+            server->logger.err(id, ": Failed to start the core in its own process.");
+            return;
+        }
+    } else {
+        Core.Load(corePath.c_str(), server->coreDirectory / "instances");
+
+        Core.SetEnvironment(OnEnvironment);
+        Core.SetVideoRefresh(OnVideoRefresh);
+        Core.SetInputPoll(OnPollInput);
+        Core.SetInputState(OnGetInputState);
+        Core.SetAudioSample(OnLRAudioSample);
+        Core.SetAudioSampleBatch(OnBatchAudioSample);
+        Core.Init();
+    }
 
-    // If provided an empty path, just skip this part. Leaving a blank path allows for cores that don't need roms to be loaded
-    if(!romPath.empty()) {
-        retro_game_info info = {romPath.c_str(), nullptr, static_cast<size_t>(boost::filesystem::file_size(romFile)),
-                                nullptr};
-        std::ifstream fo(romFile.string(), std::ios::binary);
+    server->logger.log(id, ": Finished initialization. Using ",
+                       PixelConversion::SimdLevelName(PixelConversion::DetectedSimdLevel()), " pixel conversion.");
 
+    // If provided an empty path, just skip this part. Leaving a blank path allows for cores that don't need roms to be loaded
+    // An isolated core has already loaded it in its own process
+    if(!isolated && !romPath.empty()) {
         retro_system_info system{};
         Core.GetSystemInfo(&system);
 
-        if (!system.need_fullpath) {
-            romData = new char[boost::filesystem::file_size(romFile)];
-            info.data = static_cast<void *>(romData);
-
-            if (!info.data) {
-                server->logger.err(id, ": Failed to allocate memory for the ROM");
-                return;
-            }
-
-            if (!fo.read(romData, boost::filesystem::file_size(romFile))) {
-                server->logger.err(id, ": Failed to load data from the file. Do you have the correct access rights?");
-                return;
-            }
+        // Archives are decompressed in memory (or onto a tmpfs for need_fullpath cores), plain roms are mapped
+        // read-only. Either way it's shared with every other emulator running the same rom.
+        std::string error;
+        romData = RomImage::Load(romFile, system.need_fullpath,
+                                 server->config.get<std::string>(nlohmann::json::value_t::string, "serverConfig",
+                                                                 "roms", "extractDirectory"),
+                                 error);
+        if (!romData) {
+            server->logger.err(id, ": Failed to load the rom: ", error);
+            return;
         }
 
-        // TODO: compressed roms and stuff
+        retro_game_info info{romData->Path().c_str(), romData->Data(), romData->Size(), nullptr};
 
         if (!Core.LoadGame(&info)) {
             server->logger.err(id, ": Failed to load game. Was the rom the correct file type?");
@@ -306,15 +387,22 @@ void EmulatorController::Run(const std::string& corePath, const std::string& rom
 
     Core.GetAudioVideoInfo(&avinfo);
 
-    unsigned msWait = (1.0 / avinfo.timing.fps) * 1000;
-    std::chrono::time_point<std::chrono::steady_clock> nextRun =
-            std::chrono::steady_clock::now() + std::chrono::milliseconds(msWait / (fastForward ? 2 : 1));
+    rewindInterval = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig", "rewind",
+                                               "captureInterval");
+    rewindBuffer.Configure(config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                     "rewind", "maxMemory"));
+    std::uint64_t framesSinceCapture = 0;
+
+    pacer.SetRate(avinfo.timing.fps);
+    auto nextPacingReport = std::chrono::steady_clock::now() + std::chrono::minutes(1);
 
     // Set FPS if applicable
     auto overrideFPS = server->config.get<bool>(nlohmann::json::value_t::boolean, "serverConfig", "emulators", id,
                                                 "overrideFramerate");
     std::chrono::microseconds frameDeltaTime;
 
+    recording = config.get<bool>(nlohmann::json::value_t::boolean, "serverConfig", "emulators", id, "recording");
+
     if (overrideFPS) {
         auto newFPS = server->config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
                                                         "emulators", id, "fps");
@@ -323,7 +411,6 @@ void EmulatorController::Run(const std::string& corePath, const std::string& rom
 
     // Terrible main emulator loop that manages all the things
     std::chrono::time_point<std::chrono::steady_clock> turnEnd, nextFrame;
-    bool frameSkip = false;
     while (true) {
         // Check turn state
         // Possible race condition but wouldn't really matter because it'd be a read during a write onto a boolean value
@@ -365,7 +452,7 @@ void EmulatorController::Run(const std::string& corePath, const std::string& rom
         }
 
         // While there's work and we have time before the next retro_run call
-        while (!workQueue.empty() && (std::chrono::steady_clock::now() < nextRun) &&
+        while (!workQueue.empty() && (std::chrono::steady_clock::now() < pacer.NextDeadline()) &&
                (!overrideFPS || (std::chrono::steady_clock::now() < nextFrame))) {
             auto &command = workQueue.front();
 
@@ -377,7 +464,7 @@ void EmulatorController::Run(const std::string& corePath, const std::string& rom
                     Backup();
                     break;
                 case kEmuCommandType::GeneratePreview:
-                    server->GeneratePreview(id);
+                    previewPending = true;
                     break;
                 case kEmuCommandType::TurnRequest:
                     if (command.user_hdl)
@@ -396,6 +483,14 @@ void EmulatorController::Run(const std::string& corePath, const std::string& rom
                     ++users;
                     EmulatorController::SendTurnList();
                     break;
+                case kEmuCommandType::Record:
+                    recording = config.get<bool>(nlohmann::json::value_t::boolean, "serverConfig", "emulators", id,
+                                                 "recording");
+                    break;
+                case kEmuCommandType::Rewind:
+                    Rewind(command.value);
+                    framesSinceCapture = 0;
+                    break;
             }
             std::unique_lock <std::mutex> lk(queueMutex);
             workQueue.pop();
@@ -404,19 +499,60 @@ void EmulatorController::Run(const std::string& corePath, const std::string& rom
         // Wait until the next frame because at this point we've either passed the wait time (so 0 wait) or have no more work
         // NOTE: If on a slow fps rate, there will be a lot of wasted time and the turns updating and work queue will be slow
         // This relies on the fact that emulators usually want to be run 30 to 60 times a second
-        std::this_thread::sleep_until(nextRun);
-        nextRun = std::chrono::steady_clock::now() + std::chrono::milliseconds(msWait / (fastForward ? 2 : 1));
-        Core.Run();
+        pacer.SetRate(avinfo.timing.fps);
+        pacer.Wait();
 
-        if(users) {
+        // Decide up front whether this frame gets sent so the core can skip rendering the ones that don't
+        bool sendFrame = false;
+        if (users || recording) {
             if (overrideFPS && (nextFrame < std::chrono::steady_clock::now())) {
-                server->SendFrame(id);
+                sendFrame = true;
                 nextFrame = std::chrono::steady_clock::now() + frameDeltaTime;
             } else if (!overrideFPS) {
-                if (fastForward && (frameSkip ^= true)) server->SendFrame(id);
-                else server->SendFrame(id);
+                sendFrame = true;
             }
         }
+
+        // Fast forward runs several frames per tick, only the last one of them is rendered and sent
+        const unsigned batch = fastForward ? fastForwardSpeed : 1;
+        for (unsigned i = 0; i < batch; ++i) {
+            audioVideoEnable = ((i + 1 == batch) && (sendFrame || previewPending)) ? 1 : 0;
+
+            const auto now = std::chrono::steady_clock::now();
+
+            // Fast forward is faked by running frames back to back, so the core is told a normal frame passed
+            frameTime = -1;
+            if (!fastForward && lastRun.time_since_epoch().count())
+                frameTime = std::chrono::duration_cast<std::chrono::microseconds>(now - lastRun).count();
+            lastRun = now;
+
+            if (frameTimeCallback.callback)
+                frameTimeCallback.callback(frameTime < 0 ? frameTimeCallback.reference : frameTime);
+
+            Core.Run();
+        }
+
+        framesSinceCapture += batch;
+        if (rewindInterval && framesSinceCapture >= rewindInterval) {
+            CaptureRewind();
+            framesSinceCapture = 0;
+        }
+
+        if (std::chrono::steady_clock::now() > nextPacingReport) {
+            const auto stats = pacer.TakeStats();
+            if (stats.missed || stats.stalls)
+                server->logger.log(id, ": ", stats.frames, " frames paced, ", stats.missed, " late, ", stats.stalls,
+                                   " stalls, jitter ", stats.meanJitter, "us mean ", stats.maxJitter, "us max");
+            nextPacingReport = std::chrono::steady_clock::now() + std::chrono::minutes(1);
+        }
+
+        if (sendFrame)
+            server->SendFrame(id);
+
+        if (previewPending) {
+            server->GeneratePreview(id);
+            previewPending = false;
+        }
     }
 }
 
@@ -442,17 +578,58 @@ bool EmulatorController::OnEnvironment(unsigned cmd, void *data) {
             break;
         case RETRO_ENVIRONMENT_GET_OVERSCAN: // We don't (usually) want overscan
             return false;
+        case RETRO_ENVIRONMENT_GET_CAN_DUPE: // Dupes are handled in OnVideoRefresh
+            *static_cast<bool *>(data) = true;
+            break;
+        case RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER: { // Let the core render straight into the mailbox
+            auto *framebuffer = static_cast<retro_framebuffer *>(data);
+
+            std::size_t pitch;
+            auto *buffer = frames.Claim(framebuffer->width, framebuffer->height, videoFormat.fmt, pitch);
+            if (!buffer)
+                return false;
+
+            framebuffer->data = buffer;
+            framebuffer->pitch = pitch;
+            framebuffer->format = videoFormat.fmt;
+            framebuffer->memory_flags = RETRO_MEMORY_TYPE_CACHED;
+        }
+            break;
+        case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO: {
+            // Called from retro_run when the timing or geometry changes, the pacer picks up the new fps before the
+            // next frame
+            auto *info = static_cast<const retro_system_av_info *>(data);
+            if (!info)
+                return false;
+
+            avinfo = *info;
+            server->logger.log(id, ": Core changed its frame rate to ", avinfo.timing.fps);
+        }
+            break;
+        case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK: {
+            auto *callback = static_cast<const retro_frame_time_callback *>(data);
+            if (!callback)
+                return false;
+
+            frameTimeCallback = *callback;
+        }
+            break;
+        case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE: {
+            // Only a hint, cores that ignore it keep rendering everything. Frames it skips come in as dupes.
+            if (!data)
+                return false;
+
+            *static_cast<int *>(data) = audioVideoEnable;
+        }
+            break;
             // Will be implemented
         case RETRO_ENVIRONMENT_GET_LOG_INTERFACE: // See core logs
-        case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO: // I think this is called when the avinfo changes
         case RETRO_ENVIRONMENT_GET_LIBRETRO_PATH: // Path to the libretro so core
-        case RETRO_ENVIRONMENT_SET_FRAME_TIME_CALLBACK: // Use this instead of sleep_until?
         case RETRO_ENVIRONMENT_GET_RUMBLE_INTERFACE: // For rumble support for later on
         case RETRO_ENVIRONMENT_GET_CORE_ASSETS_DIRECTORY: // Where assets are stored
         case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO: // Use to see if the core recognizes the retropad (if it doesn't well....)
         case RETRO_ENVIRONMENT_GET_LANGUAGE: // Some cores might use this and its simple to add
         case RETRO_ENVIRONMENT_GET_VFS_INTERFACE: // Some cores use this and it wouldn't be hard to implement with fstream and filesystem being a thing
-        case RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE: // Some cores might not use audio, so don't even bother with sending the audio streams
         case RETRO_ENVIRONMENT_GET_HW_RENDER_INTERFACE: // Might want this for support for more hardware accelerated cores
         default:return false;
             // clang-format on
@@ -462,7 +639,10 @@ bool EmulatorController::OnEnvironment(unsigned cmd, void *data) {
 
 void EmulatorController::OnVideoRefresh(const void *data, unsigned width, unsigned height,
                                         size_t pitch) {
-    std::unique_lock <std::mutex> lk(videoMutex);
+    // Dupe: the core wants the last frame shown again, which is still the latest one in the mailbox
+    if (data == nullptr)
+        return;
+
     if (width != videoFormat.width || height != videoFormat.height ||
         pitch != videoFormat.pitch) {
         std::clog << "Screen Res changed from " << videoFormat.width << 'x'
@@ -471,11 +651,10 @@ void EmulatorController::OnVideoRefresh(const void *data, unsigned width, unsign
         videoFormat.width = width;
         videoFormat.height = height;
         videoFormat.pitch = pitch;
-        videoFormat.stride = videoFormat.width - 16 * std::ceil(videoFormat.width / 16.0);
-        videoFormat.buffer = std::vector <std::uint8_t>((videoFormat.width + videoFormat.stride) * videoFormat.height * 4);
     }
 
-    currentBuffer = data;
+    frames.Publish(Frame{width, height, static_cast<std::uint32_t>(pitch), static_cast<const std::uint8_t *>(data),
+                         videoFormat.fmt});
 }
 
 void EmulatorController::OnPollInput() {}
@@ -543,216 +722,23 @@ bool EmulatorController::SetPixelFormat(const retro_pixel_format fmt) {
         return true;
 
     switch (fmt) {
-        // TODO: Find a core that uses this and test it
-        case RETRO_PIXEL_FORMAT_0RGB1555: {  // 16 bit
-            // rrrrrgggggbbbbba
+        case RETRO_PIXEL_FORMAT_0RGB1555:  // 16 bit
+            // 0rrrrrgggggbbbbb
             server->logger.log(" Format set: 0RGB1555");
-            videoFormat.rMask = 0b1111100000000000;
-            videoFormat.gMask = 0b0000011111000000;
-            videoFormat.bMask = 0b0000000000111110;
-            videoFormat.aMask = 0b0000000000000000;
-
-            videoFormat.rShift = 10;
-            videoFormat.gShift = 5;
-            videoFormat.bShift = 0;
-            videoFormat.aShift = 15;
-
-            videoFormat.bitsPerPel = 16;
-
-            videoFormat.fmt = fmt;
-        }
-            return true;
-            // TODO: Fix (find a core that uses this, bsnes accuracy gives a zeroed
-            // out video buffer so thats a no go)
-        case RETRO_PIXEL_FORMAT_XRGB8888:  // 32 bit
+            break;
+        case RETRO_PIXEL_FORMAT_XRGB8888:  // 32 bit, goes to the encoder as-is
             server->logger.log(" Format set: XRGB8888");
-            videoFormat.fmt = fmt;
-            return true;
+            break;
         case RETRO_PIXEL_FORMAT_RGB565:  // 16 bit
             // rrrrrggggggbbbbb
             server->logger.log(" Format set: RGB565");
-            videoFormat.rMask = 0b1111100000000000;
-            videoFormat.gMask = 0b0000011111100000;
-            videoFormat.bMask = 0b0000000000011111;
-            videoFormat.aMask = 0b0000000000000000;
-
-            videoFormat.rShift = 11;
-            videoFormat.gShift = 5;
-            videoFormat.bShift = 0;
-            videoFormat.aShift = 16;
-
-            videoFormat.bitsPerPel = 16;
-
-            videoFormat.fmt = fmt;
-            return true;
+            break;
         default:
             return false;
     }
-}
-
-Frame EmulatorController::GetFrame() {
-    std::unique_lock <std::mutex> lk(videoMutex);
-    if (currentBuffer == nullptr) return Frame{0, 0, {}};
-
-    if(videoFormat.fmt == RETRO_PIXEL_FORMAT_XRGB8888)
-        return Frame{videoFormat.width, videoFormat.height, videoFormat.stride, static_cast<const std::uint8_t *>(currentBuffer)};
-
-    size_t j{0};
-
-    const auto *i = static_cast<const std::uint8_t *>(currentBuffer);
-    // TODO: The possible address boundary error on the last row. Probably have a check on this loop then manually do the last row
-    /*
-     * NOTE: This will assume a 16-bit format. This is due to the fact that the only 32-bit format supported by RetroArch
-     * is XRGB8888, which is supported by turbojpeg2 out of the box. The rest of the possible formats are 16-bit.
-     */
-
-    // Get a scalar to multiply our three R, G, and B vecs by to move it from nbit to 8bit
-    const std::uint8_t &rMax = 1 << (videoFormat.aShift - videoFormat.rShift);
-    const std::uint8_t &gMax = 1 << (videoFormat.rShift - videoFormat.gShift);
-    const std::uint8_t &bMax = 1 << (videoFormat.gShift - videoFormat.bShift);
-
-    const std::uint16_t rScalar = 255.0 / rMax;
-    const std::uint16_t gScalar = 255.0 / gMax;
-    const std::uint16_t bScalar = 255.0 / bMax;
-
-    for (size_t h = 0; h < videoFormat.height; ++h) {
-        for (size_t w = 0; w < (videoFormat.width + videoFormat.stride) / 16; w++) {
-            // Translation step: format -> generic pixel vectors
-            // 2x 8 bytes (pixels) packed -> 3 vecs, R, G, B, __m128i (16px)
-            __m128i rVec, gVec, bVec;
-            for(int q = 0; q < 2; ++q) {
-                __m128i px8 = _mm_loadu_si128((__m128i *)i);
-                i += 16;
-
-                // Pull out the r, g, b values from the packed pixels
-                __m128i mask = _mm_set1_epi16(videoFormat.rMask);
-                __m128i rVals = _mm_and_si128(px8, mask);
-                rVals = _mm_srli_epi16(rVals, videoFormat.rShift);
-                __m128i rMult = _mm_set1_epi16(rScalar);
-                rVals = _mm_mullo_epi16(rVals, rMult);
-
-                mask = _mm_set1_epi16(videoFormat.gMask);
-                __m128i gVals = _mm_and_si128(px8, mask);
-                gVals = _mm_srli_epi16(gVals, videoFormat.gShift);
-                __m128i gMult = _mm_set1_epi16(gScalar);
-                gVals = _mm_mullo_epi16(gVals, gMult);
-
-                mask = _mm_set1_epi16(videoFormat.bMask);
-                __m128i bVals = _mm_and_si128(px8, mask);
-                bVals = _mm_srli_epi16(bVals, videoFormat.bShift);
-                __m128i bMult = _mm_set1_epi16(bScalar);
-                bVals = _mm_mullo_epi16(bVals, bMult);
-
-                // At this point, each of the individual vecs has values like so (1 block = 8 bits):
-                // | 0 | X | 0 | X | 0 | X | 0 | X | 0 | X | 0 | X | 0 | X | 0 | X |
-                // So, we need to pack the numbers together (remove the 0) and make a 64bit vec, which in another loop of this is combined into a 128i vec
-                if (q == 0) {
-                    const __m128i hiMask = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 128, 128, 128, 128, 128, 128, 128,
-                                                         128);
-
-                    rVec = _mm_shuffle_epi8(rVals, hiMask);
-                    gVec = _mm_shuffle_epi8(gVals, hiMask);
-                    bVec = _mm_shuffle_epi8(bVals, hiMask);
-                } else {
-                    const __m128i loMask = _mm_setr_epi8(128, 128, 128, 128, 128, 128, 128, 128, 0, 2, 4, 6, 8, 10, 12, 14);
-
-                    // Have a temporary to store the result of the shuffle
-                    __m128i temp = _mm_shuffle_epi8(rVals, loMask);
-                    // OR the hi and lo parts of the
-                    rVec = _mm_or_si128(temp, rVec);
-
-                    temp = _mm_shuffle_epi8(gVals, loMask);
-                    gVec = _mm_or_si128(temp, gVec);
-
-                    temp = _mm_shuffle_epi8(bVals, loMask);
-                    bVec = _mm_or_si128(temp, bVec);
-                }
-            }
-
-            // With translation done, we now have a 16px R, G, B vecs that need interleaved into XRGB8888
-            // This interleaving will yield 16px * 4 channels per px * 8 bits per channel / 128 bits per vec = 4 XRGB vecs
-
-            // Interleaving masks
-            const __m128i rInterleaveMask = _mm_setr_epi8(128, 0, 128, 128, 128, 1, 128, 128, 128, 2, 128, 128, 128, 3, 128, 128);
-            const __m128i gInterleaveMask = _mm_setr_epi8(128, 128, 0, 128, 128, 128, 1, 128, 128, 128, 2, 128, 128, 128, 3, 128);
-            const __m128i bInterleaveMask = _mm_setr_epi8(128, 128, 128, 0, 128, 128, 128, 1, 128, 128, 128, 2, 128, 128, 128, 3);
-
-            /*
-             * Now, usually you could just use a loop for this kind of thing, but, the way that SSE is
-             * implemented or the way its spec is, I couldn't use a loop for this kinda thing, you need a
-             * compile-time constant
-             *
-             * So, without further ado, copy-pasta-orama!
-             */
-
-            // Extract first value
-            __m128i ri = _mm_shuffle_epi32(rVec, 0);
-            __m128i gi = _mm_shuffle_epi32(gVec, 0);
-            __m128i bi = _mm_shuffle_epi32(bVec, 0);
-
-            // Space out values so they can be OR'd together (interleaved)
-            __m128i r0 = _mm_shuffle_epi8(ri, rInterleaveMask);
-            __m128i g0 = _mm_shuffle_epi8(gi, gInterleaveMask);
-            __m128i b0 = _mm_shuffle_epi8(bi, bInterleaveMask);
-
-            {
-                SSE128i xrgb = {_mm_or_si128( _mm_or_si128(r0, g0), b0)};
-                for(const auto& u8 : xrgb.data8)
-                    videoFormat.buffer[j++] = u8;
-            }
-
-            // 2nd value...
-            ri = _mm_shuffle_epi32(rVec, 1);
-            gi = _mm_shuffle_epi32(gVec, 1);
-            bi = _mm_shuffle_epi32(bVec, 1);
-
-            r0 = _mm_shuffle_epi8(ri, rInterleaveMask);
-            g0 = _mm_shuffle_epi8(gi, gInterleaveMask);
-            b0 = _mm_shuffle_epi8(bi, bInterleaveMask);
-
-            {
-                SSE128i xrgb = {_mm_or_si128( _mm_or_si128(r0, g0), b0)};
-                for(const auto& u8 : xrgb.data8)
-                    videoFormat.buffer[j++] = u8;
-            }
-
-            // 3rd value...
-            ri = _mm_shuffle_epi32(rVec, 2);
-            gi = _mm_shuffle_epi32(gVec, 2);
-            bi = _mm_shuffle_epi32(bVec, 2);
-
-            r0 = _mm_shuffle_epi8(ri, rInterleaveMask);
-            g0 = _mm_shuffle_epi8(gi, gInterleaveMask);
-            b0 = _mm_shuffle_epi8(bi, bInterleaveMask);
-
-            {
-                SSE128i xrgb = {_mm_or_si128( _mm_or_si128(r0, g0), b0)};
-                for(const auto& u8 : xrgb.data8)
-                    videoFormat.buffer[j++] = u8;
-            }
-
-            // aaaand the 4th value
-            ri = _mm_shuffle_epi32(rVec, 3);
-            gi = _mm_shuffle_epi32(gVec, 3);
-            bi = _mm_shuffle_epi32(bVec, 3);
-
-            r0 = _mm_shuffle_epi8(ri, rInterleaveMask);
-            g0 = _mm_shuffle_epi8(gi, gInterleaveMask);
-            b0 = _mm_shuffle_epi8(bi, bInterleaveMask);
-
-            {
-                SSE128i xrgb = {_mm_or_si128( _mm_or_si128(r0, g0), b0)};
-                for(const auto& u8 : xrgb.data8)
-                    videoFormat.buffer[j++] = u8;
-            }
-
-        }
-
-        i -= 2*videoFormat.stride; // We will have overrun the row by *stride* number of pixels, so correct that before the next line which assumes we're at the end
-        i += videoFormat.pitch - 2*videoFormat.width;
-    }
 
-    return Frame{videoFormat.width, videoFormat.height, videoFormat.stride, videoFormat.buffer.data()};
+    videoFormat.fmt = fmt;
+    return true;
 }
 
 void EmulatorController::Save() {
@@ -764,102 +750,173 @@ void EmulatorController::Save() {
         return;
     }
 
-    std::vector<unsigned char> saveData(size);
+    auto saveData = stateWriter.Acquire(size);
 
     if (!Core.SaveState(saveData.data(), size)) {
         server->logger.log(id, ": Warning; Failed to serialize data with size ", size, ".");
         return;
     }
 
-    auto newSaveFile = dataDirectory / "history" / "current.state";
+    // Rotating the history and writing happen on the writer thread
+    auto maxHistorySize = server->config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned,
+                                                            "serverConfig", "backups", "maxHistorySize");
+    stateWriter.Save(std::move(saveData), maxHistorySize);
+}
+
+void EmulatorController::Backup() {
+    if (!boost::filesystem::exists(
+            dataDirectory / "history" / "current.state")) // Create a current.state save if none exists
+        Save();
+
+    namespace chrono = std::chrono;
+    auto tp = chrono::system_clock::now().time_since_epoch();
+    auto timestamp = std::to_string(chrono::duration_cast<chrono::seconds>(tp).count());
 
-    if (boost::filesystem::exists(newSaveFile)) { // Move current file to a backup if if exists
-        server->logger.log(id, ": Existing state detected; Moving to new state.");
-        namespace chrono = std::chrono;
+    // Queued behind any pending save, so current.state is on disk by the time this runs
+    stateWriter.Post([dataDirectory = dataDirectory, saveDirectory = saveDirectory, timestamp]() {
+        // Copy any emulator generated files over
+        auto currentBackup = dataDirectory / "backups" / timestamp;
 
-        auto tp = chrono::system_clock::now().time_since_epoch();
-        auto timestamp = std::to_string(chrono::duration_cast<chrono::seconds>(tp).count());
+        std::function<void(const boost::filesystem::path &, const boost::filesystem::path &)> recursive_copy;
+        recursive_copy = [&recursive_copy](const boost::filesystem::path &src, const boost::filesystem::path &dst) {
+            if (boost::filesystem::exists(dst)) {
+                return;
+            }
 
-        auto backupName = dataDirectory / "history" / (timestamp + ".state");
+            if (boost::filesystem::is_directory(src)) {
+                boost::filesystem::create_directories(dst);
+                for (auto &item : boost::filesystem::directory_iterator(src)) {
+                    recursive_copy(item.path(), dst / item.path().filename());
+                }
+            } else if (boost::filesystem::is_regular_file(src)) {
+                boost::filesystem::copy(src, dst);
+            }
+        };
 
-        server->logger.log(id, ": Moved current state to ", backupName.string());
+        if (!boost::filesystem::is_empty(saveDirectory))
+            recursive_copy(saveDirectory, currentBackup);
 
-        boost::filesystem::rename(newSaveFile, backupName);
-    }
+        // Copy current history state over
+        boost::filesystem::copy(dataDirectory / "history" / "current.state",
+                                dataDirectory / "backups" / "states" / (timestamp + ".state"));
+    });
+}
 
-    // Remove old temporaries
-    {
-        std::vector<boost::filesystem::path> temporaryStates;
-        for (auto &p : boost::filesystem::directory_iterator(dataDirectory / "history")) {
-            auto &path = p.path();
+bool EmulatorController::StartCoreHost(const std::string &corePath, const std::string &romPath) {
+    auto &config = server->config;
 
-            if (boost::filesystem::is_regular_file(path) && path.extension() == ".state" && path.filename() != "current")
-                temporaryStates.push_back(path);
-        }
+    coreHostOptions.corePath = corePath;
+    coreHostOptions.romPath = romPath;
+    coreHostOptions.extractDirectory = config.get<std::string>(nlohmann::json::value_t::string, "serverConfig", "roms",
+                                                               "extractDirectory");
+    coreHostOptions.systemDirectory = server->systemDirectory.string();
+    coreHostOptions.saveDirectory = saveDirectory.string();
+    coreHostOptions.username = id;
+    coreHostOptions.stallTimeout = std::chrono::milliseconds(
+            config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig", "emulators", id,
+                                      "isolation", "stallTimeout"));
+
+    if (!coreHost.Start(coreHostOptions, server->logger, id))
+        return false;
+
+    // Everything else keeps calling Core as usual
+    Core.Run = []() { RunCoreHost(); };
+    Core.SaveStateSize = []() { return coreHost.SaveStateSize(); };
+    Core.SaveState = [](void *data, size_t size) { return coreHost.SaveState(data, size); };
+    Core.LoadState = [](const void *data, size_t size) { return coreHost.LoadState(data, size); };
+    Core.GetAudioVideoInfo = [](retro_system_av_info *info) { coreHost.GetAudioVideoInfo(*info); };
 
-        auto maxHistorySize = server->config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned,
-                                                                "serverConfig", "backups", "maxHistorySize");
-        if (temporaryStates.size() > maxHistorySize) {
-            // Sort by filename
-            std::sort(temporaryStates.begin(), temporaryStates.end(), [](const auto &a, const auto &b) {
-                return a.string() < b.string();
-            });
-
-            // Delete the oldest file
-            server->logger.log(id, ": Over threshold; Removing ", temporaryStates.front().string());
-            boost::filesystem::remove(temporaryStates.front());
+    return true;
+}
+
+void EmulatorController::RunCoreHost() {
+    if (!coreHost.Alive()) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now < nextCoreRestart)
+            return;
+
+        nextCoreRestart = now + std::chrono::milliseconds(
+                server->config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                  "emulators", id, "isolation", "restartDelay"));
+
+        server->logger.err(id, ": Restarting the core.");
+        if (!coreHost.Start(coreHostOptions, server->logger, id)) {
+            server->logger.err(id, ": Failed to restart the core.");
+            return;
         }
 
+        // Back to the newest rewind capture, or the last save if there's none
+        if (!rewindState.empty())
+            coreHost.LoadState(rewindState.data(), rewindState.size());
+        else
+            Load();
     }
 
-    std::ofstream fo(newSaveFile.string(), std::ios::binary);
-    fo.write(reinterpret_cast<char *>(saveData.data()), size);
-}
+    if (!coreHost.Run(joypad, audioVideoEnable, frameTime)) {
+        server->logger.err(id, ": The core crashed or stalled.");
+        return;
+    }
 
-void EmulatorController::Backup() {
-    if (!boost::filesystem::exists(
-            dataDirectory / "history" / "current.state")) // Create a current.state save if none exists
-        Save();
+    // One copy out of the shared memory into the mailbox
+    Frame frame;
+    if (coreHost.TakeFrame(frame))
+        frames.Publish(frame);
 
-    std::unique_lock <std::shared_timed_mutex> lk(generalMutex);
+    retro_system_av_info info;
+    if (coreHost.TakeAudioVideoInfo(info)) {
+        if (info.timing.fps != avinfo.timing.fps)
+            server->logger.log(id, ": Core changed its frame rate to ", info.timing.fps);
+        avinfo = info;
+    }
+}
 
-    namespace chrono = std::chrono;
-    auto tp = chrono::system_clock::now().time_since_epoch();
-    auto timestamp = std::to_string(chrono::duration_cast<chrono::seconds>(tp).count());
+void EmulatorController::CaptureRewind() {
+    std::unique_lock <std::shared_timed_mutex> lk(generalMutex);
+    const auto size = Core.SaveStateSize();
+    if (size == 0)
+        return;
 
-    // Copy any emulator generated files over
-    auto currentBackup = dataDirectory / "backups" / timestamp;
+    rewindState.resize(size);
+    if (Core.SaveState(rewindState.data(), size))
+        rewindBuffer.Push(rewindState.data(), size);
+}
 
-    std::function<void(const boost::filesystem::path &, const boost::filesystem::path &)> recursive_copy;
-    recursive_copy = [&recursive_copy](const boost::filesystem::path &src, const boost::filesystem::path &dst) {
-        if (boost::filesystem::exists(dst)) {
-            return;
-        }
+void EmulatorController::Rewind(std::uint64_t ms) {
+    std::unique_lock <std::shared_timed_mutex> lk(generalMutex);
+    if (!rewindInterval || rewindState.empty()) { // Nothing captured yet
+        server->logger.log(id, ": Nothing to rewind to.");
+        return;
+    }
 
-        if (boost::filesystem::is_directory(src)) {
-            boost::filesystem::create_directories(dst);
-            for (auto &item : boost::filesystem::directory_iterator(src)) {
-                recursive_copy(item.path(), dst / item.path().filename());
-            }
-        } else if (boost::filesystem::is_regular_file(src)) {
-            boost::filesystem::copy(src, dst);
-        }
-    };
+    // The newest capture is already up to one interval old, round to the nearest capture from there
+    const double captures = (ms / 1000.0) * avinfo.timing.fps / rewindInterval;
+    const auto steps = rewindBuffer.Rewind(static_cast<std::size_t>(captures + 0.5), rewindState);
 
-    if (!boost::filesystem::is_empty(saveDirectory))
-        recursive_copy(saveDirectory, currentBackup);
+    if (!Core.LoadState(rewindState.data(), rewindState.size())) {
+        server->logger.log(id, ": Warning; Failed to load rewind state.");
+        return;
+    }
 
-    // Copy current history state over
-    boost::filesystem::copy(dataDirectory / "history" / "current.state",
-                          dataDirectory / "backups" / "states" / (timestamp + ".state"));
+    server->logger.log(id, ": Rewound ", steps, " captures (",
+                       static_cast<std::uint64_t>(steps * rewindInterval * 1000 / avinfo.timing.fps), " ms)");
 }
 
 void EmulatorController::FastForward() {
     const auto &now = std::chrono::steady_clock::now();
+    auto &config = server->config;
 
     // limit rate that the fast forward state can be toggled
-    if (now > (lastFastForward + std::chrono::milliseconds(
-            150))) { // 150 ms ~= 7 clicks per second ~= how fast the average person can click
+    const auto cooldown = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                    "emulators", id, "fastForward", "toggleCooldown");
+    if (now > (lastFastForward + std::chrono::milliseconds(cooldown))) {
+        lastFastForward = now;
+
+        const auto speed = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                     "emulators", id, "fastForward", "speed");
+        const auto maxSpeed = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                        "emulators", id, "fastForward", "maxSpeed");
+        fastForwardSpeed = static_cast<unsigned>(std::max<std::uint64_t>(1, std::min(speed, maxSpeed)));
+
         // yay types
         bool b = fastForward;
         b ^= true;
@@ -0,0 +1,174 @@
+#include "FrameHash.h"
+
+#include <cstring>
+
+#include "Simd.h"
+
+/*
+ * Every row is consumed in 32 byte blocks (the last one zero padded) by four 64-bit accumulator lanes:
+ *      acc[i] += lo32(d ^ key[i]) * hi32(d ^ key[i]) + d
+ * which is one mul_epu32 per lane on the vector paths. The lanes are folded together at the end.
+ *
+ * The keys move on by kStep after every block, so block n of the frame (counting across rows) is keyed differently
+ * from every other block. Otherwise the sum wouldn't depend on where a block is, and a sprite moving over a plain
+ * background would give the same hash.
+ */
+namespace FrameHash {
+    /**
+     * Per-lane secrets, taken from the fractional digits of pi
+     */
+    static constexpr std::uint64_t kKeys[4] = {0x243F6A8885A308D3ull, 0x13198A2E03707344ull,
+                                               0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull};
+
+    /**
+     * Size of a block in bytes
+     */
+    static constexpr std::size_t kBlock = 32;
+
+    /**
+     * Added to every key after each block (2^64 / golden ratio, odd so the keys don't repeat for 2^64 blocks)
+     */
+    static constexpr std::uint64_t kStep = 0x9E3779B97F4A7C15ull;
+
+    static inline void AccumulateScalar(std::uint64_t acc[4], std::uint64_t keys[4], const std::uint8_t *block) {
+        for (int i = 0; i < 4; ++i) {
+            std::uint64_t d;
+            std::memcpy(&d, block + 8 * i, sizeof(d));
+            const std::uint64_t dk = d ^ keys[i];
+            acc[i] += (dk & 0xFFFFFFFFull) * (dk >> 32) + d;
+            keys[i] += kStep;
+        }
+    }
+
+    static void HashRowsScalar(const Frame &frame, std::size_t rowSize, std::uint64_t acc[4]) {
+        std::uint64_t keys[4] = {kKeys[0], kKeys[1], kKeys[2], kKeys[3]};
+
+        for (std::uint32_t y = 0; y < frame.height; ++y) {
+            const std::uint8_t *row = frame.data + std::size_t(y) * frame.pitch;
+            std::size_t x = 0;
+            for (; x + kBlock <= rowSize; x += kBlock)
+                AccumulateScalar(acc, keys, row + x);
+
+            if (x < rowSize) {
+                std::uint8_t tail[kBlock] = {};
+                std::memcpy(tail, row + x, rowSize - x);
+                AccumulateScalar(acc, keys, tail);
+            }
+        }
+    }
+
+#ifdef LP_X86_KERNELS
+    LP_TARGET("ssse3")
+    static inline void AccumulateSSSE3(__m128i &acc0, __m128i &acc1, __m128i &key0, __m128i &key1,
+                                       const __m128i step, const std::uint8_t *block) {
+        const __m128i d0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+        const __m128i d1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16));
+        const __m128i dk0 = _mm_xor_si128(d0, key0);
+        const __m128i dk1 = _mm_xor_si128(d1, key1);
+
+        acc0 = _mm_add_epi64(acc0, _mm_add_epi64(_mm_mul_epu32(dk0, _mm_srli_epi64(dk0, 32)), d0));
+        acc1 = _mm_add_epi64(acc1, _mm_add_epi64(_mm_mul_epu32(dk1, _mm_srli_epi64(dk1, 32)), d1));
+        key0 = _mm_add_epi64(key0, step);
+        key1 = _mm_add_epi64(key1, step);
+    }
+
+    LP_TARGET("ssse3")
+    static void HashRowsSSSE3(const Frame &frame, std::size_t rowSize, std::uint64_t acc[4]) {
+        __m128i key0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kKeys));
+        __m128i key1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(kKeys + 2));
+        const __m128i step = _mm_set1_epi64x(static_cast<long long>(kStep));
+        __m128i acc0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc));
+        __m128i acc1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + 2));
+
+        for (std::uint32_t y = 0; y < frame.height; ++y) {
+            const std::uint8_t *row = frame.data + std::size_t(y) * frame.pitch;
+            std::size_t x = 0;
+            for (; x + kBlock <= rowSize; x += kBlock)
+                AccumulateSSSE3(acc0, acc1, key0, key1, step, row + x);
+
+            if (x < rowSize) {
+                std::uint8_t tail[kBlock] = {};
+                std::memcpy(tail, row + x, rowSize - x);
+                AccumulateSSSE3(acc0, acc1, key0, key1, step, tail);
+            }
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(acc), acc0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + 2), acc1);
+    }
+
+    LP_TARGET("avx2")
+    static inline void AccumulateAVX2(__m256i &acc, __m256i &key, const __m256i step, const std::uint8_t *block) {
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block));
+        const __m256i dk = _mm256_xor_si256(d, key);
+
+        acc = _mm256_add_epi64(acc, _mm256_add_epi64(_mm256_mul_epu32(dk, _mm256_srli_epi64(dk, 32)), d));
+        key = _mm256_add_epi64(key, step);
+    }
+
+    LP_TARGET("avx2")
+    static void HashRowsAVX2(const Frame &frame, std::size_t rowSize, std::uint64_t acc[4]) {
+        __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(kKeys));
+        const __m256i step = _mm256_set1_epi64x(static_cast<long long>(kStep));
+        __m256i vacc = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc));
+
+        for (std::uint32_t y = 0; y < frame.height; ++y) {
+            const std::uint8_t *row = frame.data + std::size_t(y) * frame.pitch;
+            std::size_t x = 0;
+            for (; x + kBlock <= rowSize; x += kBlock)
+                AccumulateAVX2(vacc, key, step, row + x);
+
+            if (x < rowSize) {
+                std::uint8_t tail[kBlock] = {};
+                std::memcpy(tail, row + x, rowSize - x);
+                AccumulateAVX2(vacc, key, step, tail);
+            }
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc), vacc);
+    }
+#endif
+
+    /**
+     * Final avalanche so that similar accumulator states give unrelated hashes
+     */
+    static inline std::uint64_t Mix(std::uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+}
+
+std::uint64_t FrameHash::Hash(const Frame &frame) {
+    return Hash(frame, PixelConversion::DetectedSimdLevel());
+}
+
+std::uint64_t FrameHash::Hash(const Frame &frame, PixelConversion::kSimdLevel level) {
+    const std::size_t rowSize = frame.width * PixelConversion::BytesPerPixel(frame.format);
+    std::uint64_t acc[4] = {kKeys[0], kKeys[1], kKeys[2], kKeys[3]};
+
+    if (frame.data) {
+        switch (level) {
+#ifdef LP_X86_KERNELS
+            case PixelConversion::kSimdLevel::AVX2:
+                HashRowsAVX2(frame, rowSize, acc);
+                break;
+            case PixelConversion::kSimdLevel::SSSE3:
+                HashRowsSSSE3(frame, rowSize, acc);
+                break;
+#endif
+            default:
+                HashRowsScalar(frame, rowSize, acc);
+                break;
+        }
+    }
+
+    std::uint64_t h = (std::uint64_t(frame.width) << 32) ^ (std::uint64_t(frame.height) << 8) ^ frame.format;
+    for (const auto lane : acc)
+        h = Mix(h ^ lane) * 0x9E3779B97F4A7C15ull;
+
+    return Mix(h);
+}
@@ -0,0 +1,125 @@
+#include "FrameMailbox.h"
+
+#include <cstring>
+#include <utility>
+
+#include "PixelConversion.h"
+
+FrameMailbox::Snapshot::Snapshot(Snapshot &&other) noexcept : m_slot(other.m_slot) {
+    other.m_slot = nullptr;
+}
+
+FrameMailbox::Snapshot &FrameMailbox::Snapshot::operator=(Snapshot &&other) noexcept {
+    if (this != &other) {
+        if (m_slot)
+            m_slot->readers.fetch_sub(1);
+        m_slot = other.m_slot;
+        other.m_slot = nullptr;
+    }
+    return *this;
+}
+
+FrameMailbox::Snapshot::~Snapshot() {
+    if (m_slot)
+        m_slot->readers.fetch_sub(1);
+}
+
+const Frame &FrameMailbox::Snapshot::frame() const {
+    static const Frame empty{};
+    return m_slot ? m_slot->frame : empty;
+}
+
+std::uint64_t FrameMailbox::Snapshot::sequence() const {
+    return m_slot ? m_slot->sequence : 0;
+}
+
+int FrameMailbox::freeSlot() const {
+    /* Any slot but the latest one that nobody is reading. A reader that starts looking at the picked slot after
+     * this check sees that it's no longer the latest one and backs off (see Latest). Both sides use sequentially
+     * consistent operations, which is what makes that check-then-recheck safe. */
+    const int latest = m_latest.load();
+    for (std::size_t i = 0; i < kSlots; ++i) {
+        if (int(i) != latest && m_slots[i].readers.load() == 0)
+            return int(i);
+    }
+    return -1;
+}
+
+void FrameMailbox::publish(int index) {
+    Slot &slot = m_slots[index];
+    slot.sequence = m_sequence.load() + 1;
+
+    m_latest.store(index);
+    m_sequence.store(slot.sequence);
+}
+
+std::uint8_t *FrameMailbox::Claim(std::uint32_t width, std::uint32_t height, retro_pixel_format format,
+                                  std::size_t &pitch) {
+    // Readers only ever pick up the latest slot, so a claimed slot stays free until it's published
+    if (m_claimed < 0)
+        m_claimed = freeSlot();
+    if (m_claimed < 0)
+        return nullptr;
+
+    Slot &slot = m_slots[m_claimed];
+    pitch = std::size_t(width) * PixelConversion::BytesPerPixel(format);
+    slot.pixels.resize(pitch * height);
+    slot.frame = Frame{width, height, static_cast<std::uint32_t>(pitch), slot.pixels.data(), format};
+    return slot.pixels.data();
+}
+
+bool FrameMailbox::Publish(const Frame &frame) {
+    const int claimed = m_claimed;
+    m_claimed = -1;
+
+    // Rendered in place, the descriptor was already filled in by Claim
+    if (claimed >= 0) {
+        const Frame &rendered = m_slots[claimed].frame;
+        if (frame.data == rendered.data && frame.width == rendered.width && frame.height == rendered.height &&
+            frame.pitch == rendered.pitch && frame.format == rendered.format) {
+            publish(claimed);
+            return true;
+        }
+    }
+
+    const int free = freeSlot();
+    if (free < 0)
+        return false;
+
+    Slot &slot = m_slots[free];
+    const std::size_t rowSize = std::size_t(frame.width) * PixelConversion::BytesPerPixel(frame.format);
+    slot.pixels.resize(rowSize * frame.height);
+    if (frame.pitch == rowSize) {
+        std::memcpy(slot.pixels.data(), frame.data, rowSize * frame.height);
+    } else {
+        // Pitch can be anything the core likes (alignment, a wider internal buffer, ...), only the visible part is kept
+        for (std::uint32_t y = 0; y < frame.height; ++y)
+            std::memcpy(slot.pixels.data() + y * rowSize, frame.data + std::size_t(y) * frame.pitch, rowSize);
+    }
+
+    slot.frame = Frame{frame.width, frame.height, static_cast<std::uint32_t>(rowSize), slot.pixels.data(),
+                       frame.format};
+    publish(free);
+    return true;
+}
+
+FrameMailbox::Snapshot FrameMailbox::Latest() {
+    while (true) {
+        const int latest = m_latest.load();
+        if (latest < 0)
+            return Snapshot{};
+
+        Slot &slot = m_slots[latest];
+        slot.readers.fetch_add(1);
+
+        // Still the latest, so the writer can't have picked it since (or has finished writing it and published it)
+        if (m_latest.load() == latest)
+            return Snapshot{&slot};
+
+        slot.readers.fetch_sub(1);
+    }
+}
+
+std::uint64_t FrameMailbox::Sequence() const {
+    return m_sequence.load();
+}
@@ -0,0 +1,72 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <thread>
+
+constexpr std::chrono::microseconds FramePacer::kSpinWindow;
+
+FramePacer::FramePacer() {
+    SetRate(60);
+    restart(clock::now());
+}
+
+void FramePacer::SetRate(double fps, double speed) {
+    if (!(fps > 0))
+        fps = 60;
+    if (!(speed > 0))
+        speed = 1;
+
+    if (fps == m_fps && speed == m_speed)
+        return;
+
+    m_fps = fps;
+    m_speed = speed;
+    m_period = std::chrono::duration<double, std::nano>(1e9 / (fps * speed));
+
+    // Keep the deadline that's already set, the new period counts from there
+    restart(m_deadline);
+}
+
+void FramePacer::restart(clock::time_point start) {
+    m_epoch = start;
+    m_frame = 0;
+    m_deadline = start;
+}
+
+void FramePacer::Wait() {
+    ++m_stats.frames;
+
+    auto now = clock::now();
+    if (now > m_deadline) {
+        ++m_stats.missed;
+    } else {
+        if (m_deadline - now > kSpinWindow)
+            std::this_thread::sleep_until(m_deadline - kSpinWindow);
+
+        while ((now = clock::now()) < m_deadline)
+            std::this_thread::yield();
+
+        const double jitter = std::chrono::duration<double, std::micro>(now - m_deadline).count();
+        m_jitterSum += jitter;
+        m_stats.maxJitter = std::max(m_stats.maxJitter, jitter);
+    }
+
+    ++m_frame;
+    m_deadline = m_epoch + std::chrono::duration_cast<clock::duration>(m_period * double(m_frame));
+
+    // A whole frame behind: start over from now rather than rushing through every frame that was missed
+    if (m_deadline <= now) {
+        ++m_stats.stalls;
+        restart(now + std::chrono::duration_cast<clock::duration>(m_period));
+    }
+}
+
+FramePacer::Stats FramePacer::TakeStats() {
+    Stats stats = m_stats;
+    const auto onTime = stats.frames - stats.missed;
+    stats.meanJitter = onTime ? m_jitterSum / onTime : 0;
+
+    m_stats = Stats{};
+    m_jitterSum = 0;
+    return stats;
+}
@@ -0,0 +1,496 @@
+#include "PixelConversion.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "Simd.h"
+
+namespace PixelConversion {
+    /**
+     * @struct FormatTraits
+     *
+     * Compile-time description of where each channel lives in a 16-bit pixel. Red and blue are always
+     * 5 bits wide with blue in the low bits; green is 5 (0RGB1555) or 6 (RGB565) bits wide.
+     */
+    template<retro_pixel_format Fmt>
+    struct FormatTraits;
+
+    template<>
+    struct FormatTraits<RETRO_PIXEL_FORMAT_0RGB1555> {
+        // 0rrrrrgggggbbbbb
+        static constexpr int rShift = 10;
+        static constexpr int gShift = 5;
+        static constexpr int gBits = 5;
+    };
+
+    template<>
+    struct FormatTraits<RETRO_PIXEL_FORMAT_RGB565> {
+        // rrrrrggggggbbbbb
+        static constexpr int rShift = 11;
+        static constexpr int gShift = 5;
+        static constexpr int gBits = 6;
+    };
+
+    /**
+     * @struct Expand
+     *
+     * Constants for widening an n-bit channel to 8 bits by bit replication (abcde -> abcdeabc), which maps
+     * the max value to 255 unlike a plain shift. Done as (v * mult) >> shift so it vectorizes with a mullo.
+     */
+    template<int Bits>
+    struct Expand {
+        static constexpr int mult = (1 << Bits) + 1;
+        static constexpr int shift = 2 * Bits - 8;
+
+        static std::uint32_t scalar(std::uint32_t v) { return (v * mult) >> shift; }
+    };
+
+    template<retro_pixel_format Fmt>
+    void ConvertRowScalar(const std::uint8_t *src, std::uint8_t *dst, std::size_t width) {
+        using Traits = FormatTraits<Fmt>;
+        constexpr std::uint32_t gMask = (1u << Traits::gBits) - 1;
+
+        for (std::size_t x = 0; x < width; ++x) {
+            std::uint16_t px;
+            std::memcpy(&px, src + 2 * x, sizeof(px));
+
+            const std::uint32_t r = Expand<5>::scalar((px >> Traits::rShift) & 0x1F);
+            const std::uint32_t g = Expand<Traits::gBits>::scalar((px >> Traits::gShift) & gMask);
+            const std::uint32_t b = Expand<5>::scalar(px & 0x1F);
+
+            const std::uint32_t xrgb = (r << 16) | (g << 8) | b;
+            std::memcpy(dst + 4 * x, &xrgb, sizeof(xrgb));
+        }
+    }
+
+    /**
+     * @struct YCbCr
+     *
+     * JFIF (full range BT.601) RGB -> YCbCr coefficients in 8-bit fixed point. The bias terms include the
+     * rounding constant and, for chroma, the +128 offset.
+     */
+    struct YCbCr {
+        static constexpr std::int16_t yR = 77, yG = 150, yB = 29, yBias = 128;
+        static constexpr std::int16_t cbR = -43, cbG = -85; // cbB = 128
+        static constexpr std::int16_t crG = -107, crB = -21; // crR = 128
+        // 128.5 * 256 doesn't fit in a signed 16-bit lane, the vector paths load its bit pattern (see Bias16)
+        static constexpr std::uint16_t cBias = 32895;
+
+        /**
+         * A bias as the signed 16-bit lane value with the same bits. The sums stay in 0..65535, so the lanes are
+         * shifted right logically and the result is the same as the scalar path's.
+         */
+        static constexpr std::int16_t Bias16(std::uint16_t bias) {
+            return static_cast<std::int16_t>(bias);
+        }
+    };
+
+    template<retro_pixel_format Fmt>
+    void ConvertRowYUVScalar(const std::uint8_t *src, std::uint8_t *yDst, std::uint8_t *cbDst, std::uint8_t *crDst,
+                             std::size_t width) {
+        using Traits = FormatTraits<Fmt>;
+        constexpr std::uint32_t gMask = (1u << Traits::gBits) - 1;
+
+        for (std::size_t x = 0; x < width; ++x) {
+            std::uint16_t px;
+            std::memcpy(&px, src + 2 * x, sizeof(px));
+
+            const std::int32_t r = Expand<5>::scalar((px >> Traits::rShift) & 0x1F);
+            const std::int32_t g = Expand<Traits::gBits>::scalar((px >> Traits::gShift) & gMask);
+            const std::int32_t b = Expand<5>::scalar(px & 0x1F);
+
+            yDst[x] = static_cast<std::uint8_t>((YCbCr::yR * r + YCbCr::yG * g + YCbCr::yB * b + YCbCr::yBias) >> 8);
+            cbDst[x] = static_cast<std::uint8_t>((YCbCr::cbR * r + YCbCr::cbG * g + 128 * b + YCbCr::cBias) >> 8);
+            crDst[x] = static_cast<std::uint8_t>((128 * r + YCbCr::crG * g + YCbCr::crB * b + YCbCr::cBias) >> 8);
+        }
+    }
+
+#ifdef LP_X86_KERNELS
+    /**
+     * Splits 8 packed 16-bit pixels into 16-bit r, g and b lanes that each hold an 8-bit value
+     */
+    template<retro_pixel_format Fmt>
+    LP_TARGET("ssse3")
+    inline void UnpackRGB(__m128i px, __m128i &r, __m128i &g, __m128i &b) {
+        using Traits = FormatTraits<Fmt>;
+        const __m128i mask5 = _mm_set1_epi16(0x1F);
+        const __m128i mult5 = _mm_set1_epi16(Expand<5>::mult);
+
+        r = _mm_and_si128(_mm_srli_epi16(px, Traits::rShift), mask5);
+        g = _mm_and_si128(_mm_srli_epi16(px, Traits::gShift), _mm_set1_epi16((1 << Traits::gBits) - 1));
+        b = _mm_and_si128(px, mask5);
+
+        r = _mm_srli_epi16(_mm_mullo_epi16(r, mult5), Expand<5>::shift);
+        g = _mm_srli_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(Expand<Traits::gBits>::mult)), Expand<Traits::gBits>::shift);
+        b = _mm_srli_epi16(_mm_mullo_epi16(b, mult5), Expand<5>::shift);
+    }
+
+    /**
+     * 256-bit version of UnpackRGB, 16 pixels at a time
+     */
+    template<retro_pixel_format Fmt>
+    LP_TARGET("avx2")
+    inline void UnpackRGB(__m256i px, __m256i &r, __m256i &g, __m256i &b) {
+        using Traits = FormatTraits<Fmt>;
+        const __m256i mask5 = _mm256_set1_epi16(0x1F);
+        const __m256i mult5 = _mm256_set1_epi16(Expand<5>::mult);
+
+        r = _mm256_and_si256(_mm256_srli_epi16(px, Traits::rShift), mask5);
+        g = _mm256_and_si256(_mm256_srli_epi16(px, Traits::gShift), _mm256_set1_epi16((1 << Traits::gBits) - 1));
+        b = _mm256_and_si256(px, mask5);
+
+        r = _mm256_srli_epi16(_mm256_mullo_epi16(r, mult5), Expand<5>::shift);
+        g = _mm256_srli_epi16(_mm256_mullo_epi16(g, _mm256_set1_epi16(Expand<Traits::gBits>::mult)),
+                              Expand<Traits::gBits>::shift);
+        b = _mm256_srli_epi16(_mm256_mullo_epi16(b, mult5), Expand<5>::shift);
+    }
+
+    /*
+     * Both vector kernels work the same way: split the 16-bit lanes into r, g and b 16-bit lanes that each hold
+     * an 8-bit value, merge g and b into (g << 8 | b), then interleave that with r at 16-bit granularity. The
+     * result is one 32-bit 0x00RRGGBB lane per pixel, so every store is a full vector store.
+     */
+    template<retro_pixel_format Fmt>
+    LP_TARGET("ssse3")
+    void ConvertRowSSSE3(const std::uint8_t *src, std::uint8_t *dst, std::size_t width) {
+        std::size_t x = 0;
+        for (; x + 8 <= width; x += 8) {
+            __m128i r, g, b;
+            UnpackRGB<Fmt>(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * x)), r, g, b);
+
+            const __m128i gb = _mm_or_si128(_mm_slli_epi16(g, 8), b);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * x), _mm_unpacklo_epi16(gb, r));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * x + 16), _mm_unpackhi_epi16(gb, r));
+        }
+
+        // Leftover pixels when the width isn't a multiple of 8
+        ConvertRowScalar<Fmt>(src + 2 * x, dst + 4 * x, width - x);
+    }
+
+    template<retro_pixel_format Fmt>
+    LP_TARGET("avx2")
+    void ConvertRowAVX2(const std::uint8_t *src, std::uint8_t *dst, std::size_t width) {
+        std::size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m256i r, g, b;
+            UnpackRGB<Fmt>(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * x)), r, g, b);
+
+            const __m256i gb = _mm256_or_si256(_mm256_slli_epi16(g, 8), b);
+
+            // unpack works per 128-bit lane, giving [px 0-3 | px 8-11] and [px 4-7 | px 12-15]
+            const __m256i lo = _mm256_unpacklo_epi16(gb, r);
+            const __m256i hi = _mm256_unpackhi_epi16(gb, r);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+
+        // Leftover pixels when the width isn't a multiple of 16
+        ConvertRowSSSE3<Fmt>(src + 2 * x, dst + 4 * x, width - x);
+    }
+
+    /*
+     * YCbCr kernels. The channel math is done in 16-bit lanes with 8-bit fixed point coefficients; the
+     * constant terms are picked so every intermediate stays within [0, 65535] and a logical shift is enough.
+     */
+
+    /**
+     * Computes Y, Cb, Cr (8-bit values in 16-bit lanes) from r, g, b
+     */
+    LP_TARGET("ssse3")
+    inline void RGBToYCbCr(__m128i r, __m128i g, __m128i b, __m128i &y, __m128i &cb, __m128i &cr) {
+        y = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(YCbCr::yR)),
+                                        _mm_mullo_epi16(g, _mm_set1_epi16(YCbCr::yG))),
+                          _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(YCbCr::yB)), _mm_set1_epi16(YCbCr::yBias)));
+        cb = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(YCbCr::cbR)),
+                                         _mm_mullo_epi16(g, _mm_set1_epi16(YCbCr::cbG))),
+                           _mm_add_epi16(_mm_slli_epi16(b, 7), _mm_set1_epi16(YCbCr::Bias16(YCbCr::cBias))));
+        cr = _mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(r, 7),
+                                         _mm_mullo_epi16(g, _mm_set1_epi16(YCbCr::crG))),
+                           _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(YCbCr::crB)), _mm_set1_epi16(YCbCr::Bias16(YCbCr::cBias))));
+
+        y = _mm_srli_epi16(y, 8);
+        cb = _mm_srli_epi16(cb, 8);
+        cr = _mm_srli_epi16(cr, 8);
+    }
+
+    LP_TARGET("avx2")
+    inline void RGBToYCbCr(__m256i r, __m256i g, __m256i b, __m256i &y, __m256i &cb, __m256i &cr) {
+        y = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(YCbCr::yR)),
+                                              _mm256_mullo_epi16(g, _mm256_set1_epi16(YCbCr::yG))),
+                             _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(YCbCr::yB)),
+                                              _mm256_set1_epi16(YCbCr::yBias)));
+        cb = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(YCbCr::cbR)),
+                                               _mm256_mullo_epi16(g, _mm256_set1_epi16(YCbCr::cbG))),
+                              _mm256_add_epi16(_mm256_slli_epi16(b, 7), _mm256_set1_epi16(YCbCr::Bias16(YCbCr::cBias))));
+        cr = _mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(r, 7),
+                                               _mm256_mullo_epi16(g, _mm256_set1_epi16(YCbCr::crG))),
+                              _mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(YCbCr::crB)),
+                                               _mm256_set1_epi16(YCbCr::Bias16(YCbCr::cBias))));
+
+        y = _mm256_srli_epi16(y, 8);
+        cb = _mm256_srli_epi16(cb, 8);
+        cr = _mm256_srli_epi16(cr, 8);
+    }
+
+    template<retro_pixel_format Fmt>
+    LP_TARGET("ssse3")
+    void ConvertRowYUVSSSE3(const std::uint8_t *src, std::uint8_t *yDst, std::uint8_t *cbDst, std::uint8_t *crDst,
+                            std::size_t width) {
+        std::size_t x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m128i r, g, b, y0, cb0, cr0, y1, cb1, cr1;
+            UnpackRGB<Fmt>(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * x)), r, g, b);
+            RGBToYCbCr(r, g, b, y0, cb0, cr0);
+            UnpackRGB<Fmt>(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 2 * x + 16)), r, g, b);
+            RGBToYCbCr(r, g, b, y1, cb1, cr1);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(yDst + x), _mm_packus_epi16(y0, y1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(cbDst + x), _mm_packus_epi16(cb0, cb1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(crDst + x), _mm_packus_epi16(cr0, cr1));
+        }
+
+        ConvertRowYUVScalar<Fmt>(src + 2 * x, yDst + x, cbDst + x, crDst + x, width - x);
+    }
+
+    template<retro_pixel_format Fmt>
+    LP_TARGET("avx2")
+    void ConvertRowYUVAVX2(const std::uint8_t *src, std::uint8_t *yDst, std::uint8_t *cbDst, std::uint8_t *crDst,
+                           std::size_t width) {
+        std::size_t x = 0;
+        for (; x + 32 <= width; x += 32) {
+            __m256i r, g, b, y0, cb0, cr0, y1, cb1, cr1;
+            UnpackRGB<Fmt>(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * x)), r, g, b);
+            RGBToYCbCr(r, g, b, y0, cb0, cr0);
+            UnpackRGB<Fmt>(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + 2 * x + 32)), r, g, b);
+            RGBToYCbCr(r, g, b, y1, cb1, cr1);
+
+            // packus interleaves the 128-bit lanes of its inputs, so put the 64-bit quarters back in order
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(yDst + x),
+                                _mm256_permute4x64_epi64(_mm256_packus_epi16(y0, y1), 0xD8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(cbDst + x),
+                                _mm256_permute4x64_epi64(_mm256_packus_epi16(cb0, cb1), 0xD8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(crDst + x),
+                                _mm256_permute4x64_epi64(_mm256_packus_epi16(cr0, cr1), 0xD8));
+        }
+
+        ConvertRowYUVSSSE3<Fmt>(src + 2 * x, yDst + x, cbDst + x, crDst + x, width - x);
+    }
+#endif
+
+    template<retro_pixel_format Fmt>
+    YUVRowConverter SelectYUVConverter(kSimdLevel level) {
+        switch (level) {
+#ifdef LP_X86_KERNELS
+            case kSimdLevel::AVX2:
+                return ConvertRowYUVAVX2<Fmt>;
+            case kSimdLevel::SSSE3:
+                return ConvertRowYUVSSSE3<Fmt>;
+#endif
+            default:
+                return ConvertRowYUVScalar<Fmt>;
+        }
+    }
+
+    template<retro_pixel_format Fmt>
+    RowConverter SelectConverter(kSimdLevel level) {
+        switch (level) {
+#ifdef LP_X86_KERNELS
+            case kSimdLevel::AVX2:
+                return ConvertRowAVX2<Fmt>;
+            case kSimdLevel::SSSE3:
+                return ConvertRowSSSE3<Fmt>;
+#endif
+            default:
+                return ConvertRowScalar<Fmt>;
+        }
+    }
+
+    /**
+     * Adds a row of bytes onto a row of 16-bit column sums, the vertical half of the box filter
+     */
+    using ColumnAccumulator = void (*)(const std::uint8_t *src, std::uint16_t *sums, std::size_t count);
+
+    void AccumulateColumnsScalar(const std::uint8_t *src, std::uint16_t *sums, std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i)
+            sums[i] += src[i];
+    }
+
+#ifdef LP_X86_KERNELS
+    LP_TARGET("ssse3")
+    void AccumulateColumnsSSSE3(const std::uint8_t *src, std::uint16_t *sums, std::size_t count) {
+        const __m128i zero = _mm_setzero_si128();
+        std::size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            auto *lo = reinterpret_cast<__m128i *>(sums + i), *hi = reinterpret_cast<__m128i *>(sums + i + 8);
+            _mm_storeu_si128(lo, _mm_add_epi16(_mm_loadu_si128(lo), _mm_unpacklo_epi8(bytes, zero)));
+            _mm_storeu_si128(hi, _mm_add_epi16(_mm_loadu_si128(hi), _mm_unpackhi_epi8(bytes, zero)));
+        }
+
+        AccumulateColumnsScalar(src + i, sums + i, count - i);
+    }
+
+    LP_TARGET("avx2")
+    void AccumulateColumnsAVX2(const std::uint8_t *src, std::uint16_t *sums, std::size_t count) {
+        std::size_t i = 0;
+        for (; i + 32 <= count; i += 32) {
+            const __m256i lo = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+            const __m256i hi = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 16)));
+            auto *sumsLo = reinterpret_cast<__m256i *>(sums + i), *sumsHi = reinterpret_cast<__m256i *>(sums + i + 16);
+            _mm256_storeu_si256(sumsLo, _mm256_add_epi16(_mm256_loadu_si256(sumsLo), lo));
+            _mm256_storeu_si256(sumsHi, _mm256_add_epi16(_mm256_loadu_si256(sumsHi), hi));
+        }
+
+        AccumulateColumnsSSSE3(src + i, sums + i, count - i);
+    }
+#endif
+
+    ColumnAccumulator SelectAccumulator(kSimdLevel level) {
+        switch (level) {
+#ifdef LP_X86_KERNELS
+            case kSimdLevel::AVX2:
+                return AccumulateColumnsAVX2;
+            case kSimdLevel::SSSE3:
+                return AccumulateColumnsSSSE3;
+#endif
+            default:
+                return AccumulateColumnsScalar;
+        }
+    }
+}
+
+PixelConversion::kSimdLevel PixelConversion::DetectedSimdLevel() {
+    static const kSimdLevel level = [] {
+#if defined(LP_X86_KERNELS) && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return kSimdLevel::AVX2;
+        if (__builtin_cpu_supports("ssse3"))
+            return kSimdLevel::SSSE3;
+        return kSimdLevel::Scalar;
+#elif defined(LP_X86_KERNELS)
+        // SSSE3 is already a build requirement
+        return kSimdLevel::SSSE3;
+#else
+        return kSimdLevel::Scalar;
+#endif
+    }();
+    return level;
+}
+
+const char *PixelConversion::SimdLevelName(kSimdLevel level) {
+    switch (level) {
+        case kSimdLevel::AVX2:
+            return "AVX2";
+        case kSimdLevel::SSSE3:
+            return "SSSE3";
+        default:
+            return "scalar";
+    }
+}
+
+PixelConversion::RowConverter PixelConversion::XRGB8888Converter(retro_pixel_format fmt) {
+    return XRGB8888Converter(fmt, DetectedSimdLevel());
+}
+
+PixelConversion::RowConverter PixelConversion::XRGB8888Converter(retro_pixel_format fmt, kSimdLevel level) {
+    switch (fmt) {
+        case RETRO_PIXEL_FORMAT_0RGB1555:
+            return SelectConverter<RETRO_PIXEL_FORMAT_0RGB1555>(level);
+        case RETRO_PIXEL_FORMAT_RGB565:
+            return SelectConverter<RETRO_PIXEL_FORMAT_RGB565>(level);
+        default:
+            return nullptr;
+    }
+}
+
+void PixelConversion::ConvertFrame(RowConverter convert, const std::uint8_t *src, std::size_t srcPitch,
+                                   std::uint8_t *dst, std::size_t dstPitch, std::size_t width, std::size_t height) {
+    for (std::size_t y = 0; y < height; ++y)
+        convert(src + y * srcPitch, dst + y * dstPitch, width);
+}
+
+PixelConversion::YUVRowConverter PixelConversion::YUV444Converter(retro_pixel_format fmt) {
+    return YUV444Converter(fmt, DetectedSimdLevel());
+}
+
+PixelConversion::YUVRowConverter PixelConversion::YUV444Converter(retro_pixel_format fmt, kSimdLevel level) {
+    switch (fmt) {
+        case RETRO_PIXEL_FORMAT_0RGB1555:
+            return SelectYUVConverter<RETRO_PIXEL_FORMAT_0RGB1555>(level);
+        case RETRO_PIXEL_FORMAT_RGB565:
+            return SelectYUVConverter<RETRO_PIXEL_FORMAT_RGB565>(level);
+        default:
+            return nullptr;
+    }
+}
+
+void PixelConversion::ConvertFrameToYUV444(YUVRowConverter convert, const std::uint8_t *src, std::size_t srcPitch,
+                                           std::uint8_t *const planes[3], std::size_t planePitch,
+                                           std::size_t width, std::size_t height) {
+    for (std::size_t y = 0; y < height; ++y)
+        convert(src + y * srcPitch, planes[0] + y * planePitch, planes[1] + y * planePitch,
+                planes[2] + y * planePitch, width);
+}
+
+void PixelConversion::BoxDownscale(const std::uint8_t *src, std::size_t srcPitch, std::uint8_t *dst,
+                                   std::size_t dstPitch, std::size_t dstWidth, std::size_t dstHeight,
+                                   std::size_t channels, unsigned factor) {
+    BoxDownscale(src, srcPitch, dst, dstPitch, dstWidth, dstHeight, channels, factor, DetectedSimdLevel());
+}
+
+void PixelConversion::BoxDownscale(const std::uint8_t *src, std::size_t srcPitch, std::uint8_t *dst,
+                                   std::size_t dstPitch, std::size_t dstWidth, std::size_t dstHeight,
+                                   std::size_t channels, unsigned factor, kSimdLevel level) {
+    const std::size_t rowBytes = dstWidth * channels;
+    const std::size_t srcRowBytes = rowBytes * factor;
+    const std::uint32_t area = factor * factor;
+
+    // Each column sum has to fit in 16 bits, which holds up to 257 rows of 255
+    if (factor > 257) {
+        thread_local static std::vector<std::uint32_t> sums;
+        for (std::size_t y = 0; y < dstHeight; ++y) {
+            sums.assign(rowBytes, 0);
+
+            for (unsigned dy = 0; dy < factor; ++dy) {
+                const std::uint8_t *row = src + (y * factor + dy) * srcPitch;
+                for (std::size_t x = 0; x < dstWidth; ++x) {
+                    const std::uint8_t *block = row + x * factor * channels;
+                    for (unsigned dx = 0; dx < factor; ++dx)
+                        for (std::size_t c = 0; c < channels; ++c)
+                            sums[x * channels + c] += block[dx * channels + c];
+                }
+            }
+
+            std::uint8_t *out = dst + y * dstPitch;
+            for (std::size_t i = 0; i < rowBytes; ++i)
+                out[i] = static_cast<std::uint8_t>((sums[i] + area / 2) / area);
+        }
+        return;
+    }
+
+    /* Vertical pass first, factor rows summed into one row of column sums with the SIMD kernels, then the
+     * horizontal pass folds every factor pixels of that (factor times smaller) row into one output pixel */
+    const ColumnAccumulator accumulate = SelectAccumulator(level);
+    thread_local static std::vector<std::uint16_t> columns;
+
+    for (std::size_t y = 0; y < dstHeight; ++y) {
+        columns.assign(srcRowBytes, 0);
+        for (unsigned dy = 0; dy < factor; ++dy)
+            accumulate(src + (y * factor + dy) * srcPitch, columns.data(), srcRowBytes);
+
+        std::uint8_t *out = dst + y * dstPitch;
+        for (std::size_t x = 0; x < dstWidth; ++x) {
+            const std::uint16_t *block = columns.data() + x * factor * channels;
+            for (std::size_t c = 0; c < channels; ++c) {
+                std::uint32_t sum = 0;
+                for (unsigned dx = 0; dx < factor; ++dx)
+                    sum += block[dx * channels + c];
+                out[x * channels + c] = static_cast<std::uint8_t>((sum + area / 2) / area);
+            }
+        }
+    }
+}
@@ -1,56 +1,138 @@
 #include "RetroCore.h"
 
-RetroCore::RetroCore() = default;
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <dlfcn.h>
+
+#include "md5.h"
+
+namespace {
+    /**
+     * Private copies loaded by some instance right now, they can't be handed out twice
+     */
+    std::mutex copiesMutex;
+    std::set<std::string> copiesInUse;
 
-void RetroCore::Load(const char *corePath) {
-    namespace dll = boost::dll;
+    template<typename Signature>
+    void bind(boost::function<Signature> &function, void *handle, const char *name) {
+        void *symbol = dlsym(handle, name);
+        if (!symbol)
+            throw std::runtime_error(std::string("missing ") + name);
 
+        function = reinterpret_cast<Signature *>(symbol);
+    }
+}
+
+RetroCore::RetroCore() = default;
+
+void RetroCore::Load(const char *corePath, const boost::filesystem::path &copyDirectory) {
     std::clog << "Loading file from '" << corePath << "'\n";
 
+    handle_ = dlmopen(LM_ID_NEWLM, corePath, RTLD_NOW | RTLD_LOCAL);
+    if (!handle_) {
+        std::clog << "Couldn't load the core into its own namespace (" << dlerror() << "), using a copy instead\n";
+        handle_ = loadCopy(corePath, copyDirectory);
+    }
+
+    if (!handle_) {
+        std::cerr << "failed to load the core '" << corePath << "'\n";
+        std::exit(-3);
+    }
+
     try {
-        SetEnvironment = dll::import<void(retro_environment_t)>(corePath, "retro_set_environment",
-                                                                dll::load_mode::rtld_now);
-        SetVideoRefresh = dll::import<void(retro_video_refresh_t)>(corePath, "retro_set_video_refresh",
-                                                                   dll::load_mode::rtld_now);
-        SetInputPoll = dll::import<void(retro_input_poll_t)>(corePath, "retro_set_input_poll",
-                                                             dll::load_mode::rtld_now);
-        SetInputState = dll::import<void(retro_input_state_t)>(corePath, "retro_set_input_state",
-                                                               dll::load_mode::rtld_now);
-        SetAudioSample = dll::import<void(retro_audio_sample_t)>(corePath, "retro_set_audio_sample",
-                                                                 dll::load_mode::rtld_now);
-        SetAudioSampleBatch = dll::import<void(retro_audio_sample_batch_t)>(corePath, "retro_set_audio_sample_batch",
-                                                                            dll::load_mode::rtld_now);
-
-        Init = dll::import<void()>(corePath, "retro_init", dll::load_mode::rtld_now);
-        Deinit = dll::import<void()>(corePath, "retro_deinit", dll::load_mode::rtld_now);
-        Reset = dll::import<void()>(corePath, "retro_reset", dll::load_mode::rtld_now);
-        Run = dll::import<void()>(corePath, "retro_run", dll::load_mode::rtld_now);
-        RetroAPIVersion = dll::import<unsigned()>(corePath, "retro_api_version", dll::load_mode::rtld_now);
-        GetSystemInfo = dll::import<void(retro_system_info *)>(corePath, "retro_get_system_info",
-                                                               dll::load_mode::rtld_now);
-        GetAudioVideoInfo = dll::import<void(retro_system_av_info *)>(corePath, "retro_get_system_av_info",
-                                                                      dll::load_mode::rtld_now);
-        SetControllerPortDevice = dll::import<void(unsigned, unsigned)>(corePath,
-                                                                        "retro_set_controller_port_device",
-                                                                        dll::load_mode::rtld_now);
-        LoadGame = dll::import<bool(const retro_game_info *)>(corePath, "retro_load_game", dll::load_mode::rtld_now);
-        UnloadGame = dll::import<void()>(corePath, "retro_unload_game", dll::load_mode::rtld_now);
-
-        SaveStateSize = dll::import<size_t()>(corePath, "retro_serialize_size", dll::load_mode::rtld_now);
-        SaveState = dll::import<bool(void *, size_t)>(corePath, "retro_serialize", dll::load_mode::rtld_now);
-        LoadState = dll::import<bool(const void *, size_t)>(corePath, "retro_unserialize", dll::load_mode::rtld_now);
+        bind(SetEnvironment, handle_, "retro_set_environment");
+        bind(SetVideoRefresh, handle_, "retro_set_video_refresh");
+        bind(SetInputPoll, handle_, "retro_set_input_poll");
+        bind(SetInputState, handle_, "retro_set_input_state");
+        bind(SetAudioSample, handle_, "retro_set_audio_sample");
+        bind(SetAudioSampleBatch, handle_, "retro_set_audio_sample_batch");
+
+        bind(Init, handle_, "retro_init");
+        bind(Deinit, handle_, "retro_deinit");
+        bind(Reset, handle_, "retro_reset");
+        bind(Run, handle_, "retro_run");
+        bind(RetroAPIVersion, handle_, "retro_api_version");
+        bind(GetSystemInfo, handle_, "retro_get_system_info");
+        bind(GetAudioVideoInfo, handle_, "retro_get_system_av_info");
+        bind(SetControllerPortDevice, handle_, "retro_set_controller_port_device");
+        bind(LoadGame, handle_, "retro_load_game");
+        bind(UnloadGame, handle_, "retro_unload_game");
+
+        bind(SaveStateSize, handle_, "retro_serialize_size");
+        bind(SaveState, handle_, "retro_serialize");
+        bind(LoadState, handle_, "retro_unserialize");
 
 		loaded_ = true;
-    } catch (const boost::system::system_error &e) {
+    } catch (const std::runtime_error &e) {
         std::cerr << "failed to load a libretro function: " << e.what() << '\n';
         std::exit(-3);
     }
 }
 
+void *RetroCore::loadCopy(const char *corePath, const boost::filesystem::path &copyDirectory) {
+    if (copyDirectory.empty())
+        return nullptr;
+
+    std::string contents;
+    {
+        std::ifstream fi(corePath, std::ios::binary);
+        if (!fi)
+            return nullptr;
+        contents.assign(std::istreambuf_iterator<char>(fi), std::istreambuf_iterator<char>());
+    }
+    const auto hash = md5(contents);
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(copyDirectory, ec);
+
+    std::unique_lock<std::mutex> lk(copiesMutex);
+    for (unsigned i = 0;; ++i) {
+        const auto copy = copyDirectory / (hash + '.' + std::to_string(i) + ".so");
+        if (copiesInUse.count(copy.string()))
+            continue;
+
+        if (!boost::filesystem::exists(copy)) {
+            // Copied under a temporary name first so a half written copy is never picked up
+            auto temporary = copy;
+            temporary += ".tmp";
+            std::ofstream fo(temporary.string(), std::ios::binary);
+            if (!fo.write(contents.data(), contents.size()))
+                return nullptr;
+            fo.close();
+
+            boost::filesystem::rename(temporary, copy, ec);
+            if (ec)
+                return nullptr;
+        }
+
+        void *handle = dlopen(copy.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle) {
+            copiesInUse.insert(copy.string());
+            copy_ = copy;
+        } else {
+            std::cerr << "failed to load '" << copy.string() << "': " << dlerror() << '\n';
+        }
+        return handle;
+    }
+}
+
 RetroCore::~RetroCore() {
 
 	if (loaded_) {
 		UnloadGame();
 		Deinit();
 	}
+
+    if (handle_)
+        dlclose(handle_);
+
+    if (!copy_.empty()) {
+        std::unique_lock<std::mutex> lk(copiesMutex);
+        copiesInUse.erase(copy_.string());
+    }
 }
@@ -0,0 +1,97 @@
+#include "EncoderPool.h"
+
+#include <algorithm>
+
+EncoderPool::~EncoderPool() {
+    Stop();
+}
+
+void EncoderPool::Start(std::size_t threads, EncodeCallback encode) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+    {
+        std::unique_lock<std::mutex> lk(m_Mutex);
+        if (m_Running)
+            return;
+
+        m_Running = true;
+        m_Encode = std::move(encode);
+    }
+
+    for (std::size_t i = 0; i < threads; ++i)
+        m_Workers.emplace_back([this]() { this->work(); });
+}
+
+void EncoderPool::Stop() {
+    {
+        std::unique_lock<std::mutex> lk(m_Mutex);
+        m_Running = false;
+        m_Ready.clear();
+    }
+
+    m_Notifier.notify_all();
+    for (auto &worker : m_Workers)
+        worker.join();
+
+    m_Workers.clear();
+}
+
+bool EncoderPool::Submit(const std::string &id, FrameMailbox &frames) {
+    bool dropped;
+    {
+        std::unique_lock<std::mutex> lk(m_Mutex);
+        if (!m_Running)
+            return false;
+
+        auto &slot = m_Slots[id];
+        if (!slot) {
+            slot.reset(new Slot);
+            slot->id = id;
+        }
+
+        slot->frames = &frames;
+        dropped = slot->hasPending;
+        slot->hasPending = true;
+
+        // Already queued (dropped) or being worked on (the worker requeues it when it's done)
+        if (!dropped && !slot->busy)
+            m_Ready.push_back(slot.get());
+    }
+
+    m_Notifier.notify_one();
+    return !dropped;
+}
+
+void EncoderPool::work() {
+    std::unique_lock<std::mutex> lk(m_Mutex);
+    while (true) {
+        m_Notifier.wait(lk, [&]() { return !m_Running || !m_Ready.empty(); });
+        if (!m_Running)
+            return;
+
+        Slot *slot = m_Ready.front();
+        m_Ready.pop_front();
+
+        FrameMailbox *frames = slot->frames;
+        slot->hasPending = false;
+        slot->busy = true;
+
+        lk.unlock();
+        {
+            // Held until the callback returns, so the emulator doesn't write over the frame meanwhile
+            const auto snapshot = frames->Latest();
+            const bool duplicate = snapshot && snapshot.sequence() == slot->lastSequence;
+            slot->lastSequence = snapshot.sequence();
+
+            m_Encode(slot->id, snapshot.frame(), duplicate);
+        }
+        lk.lock();
+
+        slot->busy = false;
+        if (slot->hasPending) {
+            m_Ready.push_back(slot);
+            m_Notifier.notify_one();
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#include "EncoderProfile.h"
+
+int EncoderProfile::Flags() const {
+    return (fastDCT ? TJFLAG_FASTDCT : TJFLAG_ACCURATEDCT) | (progressive ? TJFLAG_PROGRESSIVE : 0);
+}
+
+bool EncoderProfile::FromJSON(const nlohmann::json &j, EncoderProfile &out) {
+    if (!j.is_object())
+        return false;
+
+    EncoderProfile profile;
+    try {
+        const auto subsampling = j.value("subsampling", std::string{SubsamplingName(profile.subsampling)});
+        if (subsampling == "444")
+            profile.subsampling = TJSAMP_444;
+        else if (subsampling == "422")
+            profile.subsampling = TJSAMP_422;
+        else if (subsampling == "420")
+            profile.subsampling = TJSAMP_420;
+        else if (subsampling == "gray")
+            profile.subsampling = TJSAMP_GRAY;
+        else
+            return false;
+
+        const auto dct = j.value("dct", std::string{"accurate"});
+        if (dct != "accurate" && dct != "fast")
+            return false;
+        profile.fastDCT = dct == "fast";
+
+        profile.progressive = j.value("progressive", profile.progressive);
+        profile.quality = j.value("quality", profile.quality);
+    } catch (const nlohmann::json::type_error &e) {
+        return false;
+    }
+
+    if (profile.quality < 1 || profile.quality > 100)
+        return false;
+
+    out = profile;
+    return true;
+}
+
+const char *EncoderProfile::SubsamplingName(int subsampling) {
+    switch (subsampling) {
+        case TJSAMP_444:
+            return "444";
+        case TJSAMP_422:
+            return "422";
+        case TJSAMP_420:
+            return "420";
+        case TJSAMP_GRAY:
+            return "gray";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,65 @@
+#include "JpegEncoderPool.h"
+
+constexpr std::uint32_t JpegEncoderPool::Context::kTrimAfter;
+
+JpegEncoderPool::Context::Context(JpegEncoderPool &pool) : handle{tjInitCompress()}, m_pool{pool} {}
+
+JpegEncoderPool::Context::~Context() {
+    tjDestroy(handle);
+    m_pool.m_Bytes -= m_bytes;
+}
+
+std::uint8_t *JpegEncoderPool::Context::ReserveOutput(std::uint32_t width, std::uint32_t height, int subsamp) {
+    Fit(output, tjBufSize(width, height, subsamp) + 1);
+    return output.data() + 1;
+}
+
+void JpegEncoderPool::Context::Fit(Buffer &buffer, std::size_t size) {
+    /* The same context goes from full size to quarter size and back within one frame, and a core can switch between
+     * two modes all the time, so a smaller size alone is no reason to reallocate */
+    bool reallocate = size > buffer.m_capacity;
+    if (!reallocate && size < buffer.m_capacity / 2)
+        reallocate = ++buffer.m_smallFits >= kTrimAfter;
+    else
+        buffer.m_smallFits = 0;
+
+    if (reallocate) {
+        buffer.m_data.reset(); // Don't hold both at once
+        buffer.m_data.reset(new std::uint8_t[size]);
+        buffer.m_capacity = size;
+        buffer.m_smallFits = 0;
+        account();
+    }
+
+    buffer.m_size = size;
+}
+
+void JpegEncoderPool::Context::account() {
+    const std::size_t bytes = output.capacity() + yuv.capacity() + rgb.capacity() + scaled.capacity();
+    m_pool.m_Bytes += bytes;
+    m_pool.m_Bytes -= m_bytes;
+    m_bytes = bytes;
+}
+
+JpegEncoderPool::context_ptr JpegEncoderPool::Acquire() {
+    std::unique_lock<std::mutex> lk(m_Mutex);
+
+    // Same as SharedMessagePool: use_count() == 1 means only the pool has it, and nobody can get a new reference
+    // without going through this mutex
+    for (auto &context : m_Contexts) {
+        if (context.use_count() == 1)
+            return context;
+    }
+
+    m_Contexts.push_back(std::make_shared<Context>(*this));
+    return m_Contexts.back();
+}
+
+std::size_t JpegEncoderPool::ContextCount() {
+    std::unique_lock<std::mutex> lk(m_Mutex);
+    return m_Contexts.size();
+}
+
+std::size_t JpegEncoderPool::MemoryUsage() const {
+    return m_Bytes;
+}
@@ -13,6 +13,19 @@ nlohmann::json LetsPlayConfig::defaultConfig = R"json(
                 "overrideFramerate": false,
                 "forbiddenCombos": [],
                 "fps": 60,
+                "keyframeInterval": 300,
+                "encoderProfile": "balanced",
+                "recording": false,
+                "isolation": {
+                    "enabled": false,
+                    "stallTimeout": 5000,
+                    "restartDelay": 1000
+                },
+                "fastForward": {
+                    "speed": 2,
+                    "maxSpeed": 8,
+                    "toggleCooldown": 150
+                },
                 "muting": {
                     "messagesPerInterval": 3,
                     "intervalTime": 4,
@@ -26,10 +39,43 @@ nlohmann::json LetsPlayConfig::defaultConfig = R"json(
             "historyInterval": 5,
             "maxHistorySize": 288
         },
+        "roms": {
+            "extractDirectory": "/dev/shm/letsplay-roms"
+        },
+        "rewind": {
+            "captureInterval": 30,
+            "maxMemory": 8388608
+        },
+        "dvr": {
+            "seconds": 60,
+            "bufferSize": 0
+        },
+        "recordings": {
+            "segmentSize": 67108864
+        },
+        "previews": {
+            "interval": 20000,
+            "width": 160,
+            "quality": 70,
+            "sendOnConnect": true
+        },
         "salt": "ncft9PlmVA",
         "adminHash": "be23396d825c5a17c57c7738ac4b98a5",
         "dataDirectory": "System Default",
-        "jpegQuality": 80,
+        "encoderProfiles": {
+            "quality": {"subsampling": "444", "dct": "accurate", "progressive": false, "quality": 90},
+            "balanced": {"subsampling": "444", "dct": "accurate", "progressive": false, "quality": 80},
+            "fast": {"subsampling": "420", "dct": "fast", "progressive": false, "quality": 75},
+            "small": {"subsampling": "420", "dct": "accurate", "progressive": true, "quality": 70}
+        },
+        "renditions": [
+            {"name": "full", "scale": 1, "frameInterval": 1},
+            {"name": "half", "scale": 2, "quality": 60, "frameInterval": 1},
+            {"name": "quarter", "scale": 4, "quality": 50, "frameInterval": 2}
+        ],
+        "encoderThreads": 0,
+        "maxBufferedBytes": 262144,
+        "stallTimeout": 15000,
         "heartbeatTimeout": 3000,
         "maxMessageSize": 100,
         "maxUsernameLength": 15,
@@ -28,10 +28,21 @@ void LetsPlayServer::Run(std::uint16_t port) {
             throw std::runtime_error(std::string("Failed to listen on port ") +
                 std::to_string(port));
 
+        loadRenditions();
+
         m_QueueThreadRunning = true;
 
         m_QueueThread = std::thread{[&]() { this->QueueThread(); }};
 
+        m_Encoder.Start(config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                  "encoderThreads"),
+                        [&](const EmuID_t &id, const Frame &frame, bool duplicate) {
+                            this->broadcastFrame(id, frame, duplicate);
+                        });
+
+        // Only ever given jobs with Post, so it has no history directory of its own
+        m_Exports.Start(boost::filesystem::path(), logger, "Exports");
+
         // Schedule periodic tasks
         auto savePeriod = std::chrono::minutes(
                 config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
@@ -39,6 +50,9 @@ void LetsPlayServer::Run(std::uint16_t port) {
         auto backupPeriod = std::chrono::minutes(
                 config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
                                           "backups", "backupInterval"));
+        auto previewPeriod = std::chrono::milliseconds(
+                config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                          "previews", "interval"));
 
         // Create std::function wrappers so that they can be used in the scheduler
         std::function<void()> previewFunc = [&]() { this->PreviewTask(); };
@@ -48,7 +62,7 @@ void LetsPlayServer::Run(std::uint16_t port) {
 
         scheduler.Schedule(saveFunc, savePeriod);
         scheduler.Schedule(backupFunc, backupPeriod);
-        scheduler.Schedule(previewFunc, std::chrono::seconds(20));
+        scheduler.Schedule(previewFunc, previewPeriod);
         scheduler.Schedule(pingFunc, std::chrono::seconds(5));
 
         // Skip having to connect, change username, addemu
@@ -150,8 +164,8 @@ void LetsPlayServer::OnConnect(websocketpp::connection_hdl hdl) {
         }
     }
 
-    // Put a preview send request on queue
-    {
+    // Put a preview send request on queue, clients that load the previews over HTTP can go without
+    if (config.get<bool>(nlohmann::json::value_t::boolean, "serverConfig", "previews", "sendOnConnect")) {
         std::unique_lock<std::mutex> lk(m_QueueMutex);
         m_WorkQueue.push(Command{kCommandType::Preview, {}, hdl, ""});
         m_QueueNotifier.notify_one();
@@ -270,6 +284,7 @@ void LetsPlayServer::OnHTTP(websocketpp::connection_hdl hdl) {
     const auto request = cptr->get_request();
 
     const std::regex emu_re{R"(\/emu\/([A-Za-z0-9]+)$)"};
+    const std::regex preview_re{R"(\/preview\/([A-Za-z0-9]+)\.jpg$)"};
     std::smatch m;
 
     /* If client GETs / or /emu/id, send the client code over HTTP. If path was in the form /emu/id but the emulator with
@@ -293,6 +308,33 @@ void LetsPlayServer::OnHTTP(websocketpp::connection_hdl hdl) {
 
         // Send client
         LetsPlayServer::sendHTTPFile(cptr, boost::filesystem::path(".") / "client" / "root" / "index.html", status);
+    } else if(request.get_method() == "GET" && std::regex_match(path, m, preview_re)) {
+        /* Previews change at most once per preview interval, so caches may keep them for that long and then
+         * revalidate with the ETag */
+        const auto maxAge = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                      "previews", "interval") / 1000;
+
+        std::unique_lock<std::mutex> lk(m_PreviewsMutex);
+        auto search = m_Previews.find(m[1].str());
+        if (search == m_Previews.end() || search->second.message.size() <= 1) {
+            lk.unlock();
+            cptr->set_body("404");
+            cptr->set_status(websocketpp::http::status_code::not_found);
+            return;
+        }
+
+        const auto &preview = search->second;
+        cptr->append_header("ETag", preview.etag);
+        cptr->append_header("Cache-Control", "public, max-age=" + std::to_string(maxAge));
+
+        if (request.get_header("If-None-Match") == preview.etag) {
+            cptr->set_status(websocketpp::http::status_code::not_modified);
+            return;
+        }
+
+        cptr->append_header("Content-Type", "image/jpeg");
+        cptr->set_body(std::string(preview.message.begin() + 1, preview.message.end()));
+        cptr->set_status(websocketpp::http::status_code::ok);
     } else if(request.get_method() == "GET" && path == "/admin") {
         auto status = websocketpp::http::status_code::ok;
 
@@ -348,6 +390,28 @@ void LetsPlayServer::OnMessage(websocketpp::connection_hdl hdl, wcpp_server::mes
         t = kCommandType::FastForward;
     else if (command == "pong")
         t = kCommandType::Pong;
+    else if (command == "delta")
+        t = kCommandType::Delta;
+    else if (command == "keyframe")
+        t = kCommandType::Keyframe;
+    else if (command == "stats")
+        t = kCommandType::Stats;
+    else if (command == "benchmark")  // No params
+        t = kCommandType::Benchmark;
+    else if (command == "lossless")  // No params
+        t = kCommandType::Lossless;
+    else if (command == "rendition")  // rendition name or auto
+        t = kCommandType::Rendition;
+    else if (command == "record")  // on or off
+        t = kCommandType::Record;
+    else if (command == "recordings")  // No params
+        t = kCommandType::Recordings;
+    else if (command == "export")  // session, from, to (ms since the unix epoch)
+        t = kCommandType::Export;
+    else if (command == "replay")  // ms to rewind by, 0 for live
+        t = kCommandType::Replay;
+    else if (command == "rewind")  // ms to rewind the emulator by
+        t = kCommandType::Rewind;
     else
         return;
 
@@ -423,6 +487,17 @@ void LetsPlayServer::Shutdown() {
     logger.log("Waiting for work thread to stop...");
     m_QueueThread.join();
 
+    logger.log("Stopping encoder threads...");
+    m_Encoder.Stop();
+
+    logger.log("Waiting for exports to finish...");
+    m_Exports.Stop();
+
+    if (m_BenchmarkThread.joinable()) {
+        logger.log("Waiting for the encoder benchmark to finish...");
+        m_BenchmarkThread.join();
+    }
+
     // Close every connection
     {
         logger.log("Closing every connection...");
@@ -942,6 +1017,228 @@ void LetsPlayServer::QueueThread() {
                     if (auto user = command.user_hdl.lock())
                         user->updateLastPong();
                     break;
+                case kCommandType::Delta:
+                    if (auto user = command.user_hdl.lock()) {
+                        user->supportsDelta = true;
+                        user->needsKeyframe = true;
+                    }
+                    break;
+                case kCommandType::Keyframe:
+                    if (auto user = command.user_hdl.lock())
+                        user->needsKeyframe = true;
+                    break;
+                case kCommandType::Benchmark: {
+                    {
+                        auto user = command.user_hdl.lock();
+                        if (!user || !user->hasAdmin) break;
+                    }
+
+                    /* Runs on a thread of its own, it keeps a core busy for a while and shouldn't hold up this
+                     * queue, the emulator or an encoder worker. One benchmark at a time. */
+                    if (m_BenchmarkRunning.exchange(true))
+                        break;
+                    if (m_BenchmarkThread.joinable())
+                        m_BenchmarkThread.join();
+
+                    const auto id = command.emuID;
+                    const auto user_hdl = command.user_hdl;
+                    m_BenchmarkThread = std::thread([this, id, user_hdl]() {
+                        BenchmarkEncoderProfiles(id, user_hdl);
+                        m_BenchmarkRunning = false;
+                    });
+                }
+                    break;
+                case kCommandType::Lossless:
+                    if (auto user = command.user_hdl.lock())
+                        user->supportsLossless = true;
+                    break;
+                case kCommandType::Rendition: {
+                    if (command.params.size() != 1) break;
+
+                    auto user = command.user_hdl.lock();
+                    if (!user) break;
+
+                    if (command.params[0] == "auto") {
+                        user->autoRendition = true;
+                        user->smoothFrames = 0;
+                        break;
+                    }
+
+                    auto search = std::find_if(m_Renditions.begin(), m_Renditions.end(),
+                                               [&](const Rendition &r) { return r.name == command.params[0]; });
+                    if (search == m_Renditions.end()) break;
+
+                    user->autoRendition = false;
+                    setRendition(*user, command.hdl, std::distance(m_Renditions.begin(), search));
+                }
+                    break;
+                case kCommandType::Stats: {
+                    {
+                        auto user = command.user_hdl.lock();
+                        if (!user || !user->hasAdmin) break;
+                    }
+
+                    // stats, then a username, dropped frame count and rendition for every user
+                    std::vector<std::string> message{"stats"};
+                    {
+                        std::unique_lock<std::mutex> lkk(m_UsersMutex);
+                        for (auto &pair : m_Users) {
+                            const auto r = std::min<std::size_t>(pair.second->rendition, m_Renditions.size() - 1);
+                            message.push_back(pair.second->username());
+                            message.push_back(std::to_string(pair.second->framesDropped));
+                            message.push_back(m_Renditions[r].name);
+                        }
+                    }
+
+                    BroadcastOne(LetsPlayProtocol::encode(message), command.hdl);
+
+                    // encodermem, then the number of jpeg encoder contexts and the bytes their buffers take up
+                    const auto contexts = m_JpegContexts.ContextCount();
+                    const auto bytes = m_JpegContexts.MemoryUsage();
+                    logger.log("Jpeg encoders: ", contexts, " contexts, ", bytes / 1024, " KiB of buffers");
+                    BroadcastOne(LetsPlayProtocol::encode("encodermem", contexts, bytes), command.hdl);
+                }
+                    break;
+                case kCommandType::Record: {
+                    {
+                        auto user = command.user_hdl.lock();
+                        if (!user || !user->hasAdmin) break;
+                    }
+                    if (command.params.size() != 1 || (command.params[0] != "on" && command.params[0] != "off"))
+                        break;
+
+                    // Saved to config so it survives a restart; the encoder picks it up on the next keyframe
+                    std::unique_lock<std::mutex> lkk(m_EmusMutex);
+                    auto search = m_Emus.find(command.emuID);
+                    if (search == m_Emus.end() || !search->second) break;
+
+                    config.set("serverConfig", "emulators", command.emuID, "recording", command.params[0] == "on");
+
+                    auto emu = search->second;
+                    {
+                        std::unique_lock<std::mutex> lkkk(*(emu->queueMutex));
+                        emu->queue->push(EmuCommand{kEmuCommandType::Record, {}});
+                    }
+                    emu->queueNotifier->notify_one();
+
+                    BroadcastOne(LetsPlayProtocol::encode("record", command.params[0]), command.hdl);
+                }
+                    break;
+                case kCommandType::Replay: {
+                    if (command.params.size() != 1) break;
+
+                    auto user = command.user_hdl.lock();
+                    if (!user) break;
+
+                    try {
+                        user->replayOffset = std::stoull(command.params[0]);
+                    } catch (const std::exception &) {
+                        break;
+                    }
+
+                    // Picked up by the encoder worker with the next frame
+                    user->replayRequested = true;
+                }
+                    break;
+                case kCommandType::Rewind: {
+                    {
+                        auto user = command.user_hdl.lock();
+                        if (!user || !user->hasAdmin) break;
+                    }
+                    if (command.params.size() != 1) break;
+
+                    EmuCommand c{kEmuCommandType::Rewind, command.user_hdl};
+                    try {
+                        c.value = std::stoull(command.params[0]);
+                    } catch (const std::exception &) {
+                        break;
+                    }
+
+                    std::unique_lock<std::mutex> lkk(m_EmusMutex);
+                    auto search = m_Emus.find(command.emuID);
+                    if (search == m_Emus.end() || !search->second) break;
+
+                    auto emu = search->second;
+                    {
+                        std::unique_lock<std::mutex> lkkk(*(emu->queueMutex));
+                        emu->queue->push(c);
+                    }
+                    emu->queueNotifier->notify_one();
+                }
+                    break;
+                case kCommandType::Recordings: {
+                    {
+                        auto user = command.user_hdl.lock();
+                        if (!user || !user->hasAdmin || command.emuID.empty()) break;
+                    }
+
+                    // recordings, then a session name, first and last frame time and frame count for every session
+                    std::vector<std::string> message{"recordings"};
+                    boost::system::error_code ec;
+                    const auto directory = emuDirectory / command.emuID / "recordings";
+                    for (boost::filesystem::directory_iterator it(directory, ec), end; !ec && it != end;
+                         it.increment(ec)) {
+                        RecordingReader reader;
+                        if (!reader.Open(it->path()))
+                            continue;
+
+                        message.push_back(it->path().filename().string());
+                        message.push_back(std::to_string(reader.StartTime()));
+                        message.push_back(std::to_string(reader.EndTime()));
+                        message.push_back(std::to_string(reader.FrameCount()));
+                    }
+
+                    BroadcastOne(LetsPlayProtocol::encode(message), command.hdl);
+                }
+                    break;
+                case kCommandType::Export: {
+                    {
+                        auto user = command.user_hdl.lock();
+                        if (!user || !user->hasAdmin || command.emuID.empty()) break;
+                    }
+
+                    // Session names are timestamps, which also keeps the path inside the recordings directory
+                    static const std::regex session_re{R"(\d{8}-\d{6}(-\d+)?)"};
+                    if (command.params.size() != 3 || !std::regex_match(command.params[0], session_re))
+                        break;
+
+                    // Plain digits only, stoull alone would take "1/../x" or "-1"
+                    static const std::regex time_re{R"(\d{1,20})"};
+                    if (!std::regex_match(command.params[1], time_re) ||
+                        !std::regex_match(command.params[2], time_re))
+                        break;
+
+                    std::uint64_t from, to;
+                    try {
+                        from = std::stoull(command.params[1]);
+                        to = std::stoull(command.params[2]);
+                    } catch (const std::exception &) {
+                        break;
+                    }
+
+                    // A long range can be gigabytes, so it's written on its own thread and answered when done
+                    const auto id = command.emuID, session = command.params[0];
+                    const auto out = emuDirectory / id / "exports" /
+                                     (session + '_' + std::to_string(from) + '_' + std::to_string(to) + ".mjpg");
+                    const auto hdl = command.hdl;
+                    m_Exports.Post([this, id, session, from, to, out, hdl]() {
+                        RecordingReader reader;
+                        if (!reader.Open(emuDirectory / id / "recordings" / session)) {
+                            logger.err(id, ": Recording '", session, "' not found or empty.");
+                            return;
+                        }
+
+                        // Plays with e.g. ffplay -f mjpeg
+                        boost::system::error_code ec;
+                        boost::filesystem::create_directories(out.parent_path(), ec);
+                        const auto frames = reader.Export(from, to, out);
+                        logger.log(id, ": Exported ", frames, " frames of recording '", session, "' to ",
+                                   out.string());
+
+                        BroadcastOne(LetsPlayProtocol::encode("export", out.string(), frames), hdl);
+                    });
+                }
+                    break;
                 case kCommandType::FastForward: {
                     {
                         auto user = command.user_hdl.lock();
@@ -965,10 +1262,11 @@ void LetsPlayServer::QueueThread() {
                     std::unique_lock<std::mutex> lkk(m_PreviewsMutex);
                     for (const auto &preview : m_Previews) {
                         websocketpp::lib::error_code ec;
-                        server->send(command.hdl, preview.second.data(), preview.second.size(),
+                        server->send(command.hdl, preview.second.message.data(), preview.second.message.size(),
                                      websocketpp::frame::opcode::binary, ec);
                     }
                 }
+                    break;
                 case kCommandType::RemoveEmu:
                 case kCommandType::StopEmu:
                 case kCommandType::Config:
@@ -984,13 +1282,17 @@ void LetsPlayServer::QueueThread() {
 }
 
 void LetsPlayServer::GeneratePreview(const EmuID_t &id) {
-    auto index = std::distance(m_Emus.begin(), m_Emus.find(id));
-    auto jpegData = GenerateEmuJPEG(id);
-
-    // Set binary payload info
-    jpegData[0] = index | (kBinaryMessageType::Preview << 5);
+    {
+        std::unique_lock<std::mutex> lk(m_StreamsMutex);
+        auto search = m_Streams.find(id);
+        if (search == m_Streams.end())
+            return;
+        search->second.previewRequested = true;
+    }
 
-    m_Previews[id] = jpegData;
+    /* Nothing may be sending frames if nobody is watching, so hand over the current one. If someone is, this one is
+     * the same one that was just sent and is skipped as a duplicate. */
+    SendFrame(id);
 }
 
 void LetsPlayServer::PingTask() {
@@ -1174,6 +1476,11 @@ void LetsPlayServer::BackupTask() {
 }
 
 void LetsPlayServer::AddEmu(const EmuID_t& id, EmulatorControllerProxy *emu) {
+    {
+        std::unique_lock<std::mutex> lk(m_StreamsMutex);
+        m_Streams[id];
+    }
+
     std::unique_lock<std::mutex> lk(m_EmusMutex);
     m_Emus[id] = emu;
 }
@@ -1192,55 +1499,669 @@ size_t LetsPlayServer::escapedSize(const std::string& str) {
 }
 
 std::vector<std::uint8_t> LetsPlayServer::GenerateEmuJPEG(const EmuID_t &id) {
-    thread_local static tjhandle _jpegCompressor = tjInitCompress();
-    thread_local static long unsigned int _jpegBufferSize = 20000000;
-    thread_local static std::vector<std::uint8_t> jpegData(20000000); // 20MB jpeg buffer
-    thread_local static unsigned i{0};
-    thread_local static auto quality = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned,
-                                                                 "serverConfig", "jpegQuality");
-    Frame frame = [&]() {
+    const auto jpeg = EncodeEmuJPEG(id);
+    return std::vector<std::uint8_t>(jpeg.data, jpeg.data + jpeg.size);
+}
+
+EncodedFrame LetsPlayServer::EncodeEmuJPEG(const EmuID_t &id) {
+    const auto snapshot = [&]() {
         // Possible race condition, unlocked m_EmusMutex
         auto emu = m_Emus[id];
-        return emu->getFrame();
+        return emu->frames->Latest();
     }();
+    const Frame &frame = snapshot.frame();
+
+    EncoderProfile profile;
+    lookupEncoderProfile(config.get<std::string>(nlohmann::json::value_t::string, "serverConfig", "emulators", id,
+                                                 "encoderProfile"), profile);
 
-    // currentBuffer was nullptr
-    if (frame.width == 0 || frame.height == 0) return std::vector<std::uint8_t>{0, 2};
+    return CompressJPEG(frame, profile, 1);
+}
 
-    // update quality value from config every 120 frames
-    if ((++i %= 120) == 0) {
-        auto q = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig", "jpegQuality");
+EncodedFrame LetsPlayServer::CompressJPEG(const Frame &frame, const EncoderProfile &profile, unsigned scale) {
+    static const std::uint8_t noFrame[2] = {0, 2};
+
+    scale = std::max(1u, scale);
+    const std::uint32_t width = frame.width / scale, height = frame.height / scale;
+
+    // Nothing was presented yet (or the frame is smaller than the scale)
+    if (width == 0 || height == 0) return EncodedFrame{noFrame, sizeof(noFrame), nullptr};
+
+    auto context = m_JpegContexts.Acquire();
+    auto &yuvData = context->yuv, &rgbData = context->rgb, &scaledData = context->scaled;
+
+    // Output buffer is sized for the worst case, so turbojpeg never has to reallocate it
+    const bool yuvPlanes = frame.format != RETRO_PIXEL_FORMAT_XRGB8888 && profile.subsampling == TJSAMP_444;
+    std::uint8_t *cjpegData = context->ReserveOutput(width, height, yuvPlanes ? TJSAMP_444 : profile.subsampling);
+    long unsigned int jpegSize = context->output.size() - 1;
+    const int flags = profile.Flags() | TJFLAG_NOREALLOC;
+
+    if (yuvPlanes) {
+        /* 16-bit frames go straight to Y/Cb/Cr planes so turbojpeg doesn't have to do a colour conversion pass of
+         * its own over an XRGB8888 copy. Scaled renditions are shrunk plane by plane afterwards. */
+        const std::size_t planeSize = std::size_t(frame.width) * frame.height;
+        const std::size_t scaledPlaneSize = scale > 1 ? std::size_t(width) * height : 0;
+        context->Fit(yuvData, (planeSize + scaledPlaneSize) * 3);
+
+        std::uint8_t *const planes[3] = {yuvData.data(), yuvData.data() + planeSize, yuvData.data() + 2 * planeSize};
+        PixelConversion::ConvertFrameToYUV444(PixelConversion::YUV444Converter(frame.format), frame.data, frame.pitch,
+                                              planes, frame.width, frame.width, frame.height);
+
+        const unsigned char *srcPlanes[3] = {planes[0], planes[1], planes[2]};
+        if (scale > 1) {
+            for (int p = 0; p < 3; ++p) {
+                std::uint8_t *scaled = yuvData.data() + 3 * planeSize + p * scaledPlaneSize;
+                PixelConversion::BoxDownscale(planes[p], frame.width, scaled, width, width, height, 1, scale);
+                srcPlanes[p] = scaled;
+            }
+        }
 
-        if (q > 100 || q < 1) quality = 95;
-        else quality = q;
+        const int strides[3] = {int(width), int(width), int(width)};
+        tjCompressFromYUVPlanes(context->handle, srcPlanes, width, strides, height, TJSAMP_444,
+                                &cjpegData, &jpegSize, profile.quality, flags);
+    } else {
+        const std::uint8_t *pixels = frame.data;
+        std::size_t pitch = frame.pitch;
+
+        // Subsampled 16-bit frames: turbojpeg does the chroma downsampling along with its own colour conversion
+        if (frame.format != RETRO_PIXEL_FORMAT_XRGB8888) {
+            context->Fit(rgbData, std::size_t(frame.width) * frame.height * 4);
+            PixelConversion::ConvertFrame(PixelConversion::XRGB8888Converter(frame.format), frame.data, frame.pitch,
+                                          rgbData.data(), frame.width * 4, frame.width, frame.height);
+            pixels = rgbData.data();
+            pitch = frame.width * 4;
+        }
+
+        if (scale > 1) {
+            context->Fit(scaledData, std::size_t(width) * height * 4);
+            PixelConversion::BoxDownscale(pixels, pitch, scaledData.data(), width * 4, width, height, 4, scale);
+            pixels = scaledData.data();
+            pitch = width * 4;
+        }
+
+        // XRGB8888 is native endian 0x00RRGGBB, which is BGRX in memory
+        tjCompress2(context->handle, pixels, width, pitch, height,
+                    TJPF_BGRX, &cjpegData, &jpegSize, profile.subsampling, profile.quality, flags);
     }
 
-    long unsigned int jpegSize = _jpegBufferSize;
-    std::uint8_t *cjpegData = &jpegData[1];
-    tjCompress2(_jpegCompressor, frame.data, frame.width, 16*std::ceil(frame.width/16.0) * 4, frame.height,
-                TJPF_XRGB, &cjpegData, &jpegSize, TJSAMP_444, quality, TJFLAG_ACCURATEDCT);
+    const std::uint8_t *data = context->output.data();
+    return EncodedFrame{data, jpegSize + 1, std::move(context)};
+}
+
+bool LetsPlayServer::lookupEncoderProfile(const std::string& name, EncoderProfile& out) {
+    const auto profiles = config.get<nlohmann::json>(nlohmann::json::value_t::object, "serverConfig",
+                                                     "encoderProfiles");
+    const auto search = profiles.find(name);
+    return search != profiles.end() && EncoderProfile::FromJSON(*search, out);
+}
 
-    std::vector<std::uint8_t> slicedData(std::begin(jpegData), std::next(jpegData.begin(), jpegSize + 1));
+void LetsPlayServer::refreshStreamSettings(const EmuID_t& id, EmuStream& stream) {
+    stream.keyframeInterval = std::max<std::uint64_t>(1, config.get<std::uint64_t>(
+            nlohmann::json::value_t::number_unsigned, "serverConfig", "emulators", id, "keyframeInterval"));
+    stream.maxBufferedBytes = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned,
+                                                        "serverConfig", "maxBufferedBytes");
+    stream.stallTimeout = std::chrono::milliseconds(config.get<std::uint64_t>(
+            nlohmann::json::value_t::number_unsigned, "serverConfig", "stallTimeout"));
+
+    const auto name = config.get<std::string>(nlohmann::json::value_t::string, "serverConfig", "emulators", id,
+                                              "encoderProfile");
+    EncoderProfile profile;
+    const bool valid = lookupEncoderProfile(name, profile);
+
+    // Only say something when the profile changes, this runs on every keyframe
+    if (!stream.settingsLoaded || name != stream.profileName) {
+        if (valid)
+            logger.log(id, ": Using encoder profile '", name, "'.");
+        else
+            logger.err(id, ": Unknown or invalid encoder profile '", name, "', using defaults.");
+    }
 
-    return slicedData;
+    stream.profile = profile;
+    stream.profileName = name;
+    stream.settingsLoaded = true;
+
+    const auto dvrSize = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig", "dvr",
+                                                   "bufferSize");
+    const auto dvrAge = 1000 * config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                         "dvr", "seconds");
+    if (dvrSize != stream.dvr.Capacity() || dvrAge != stream.dvr.MaxAge())
+        stream.dvr.Configure(dvrSize, dvrAge);
+
+    const bool record = config.get<bool>(nlohmann::json::value_t::boolean, "serverConfig", "emulators", id,
+                                         "recording");
+    if (record && !stream.recorder.IsRecording()) {
+        const auto segmentSize = config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned, "serverConfig",
+                                                           "recordings", "segmentSize");
+        if (stream.recorder.Start(emuDirectory / id / "recordings", segmentSize))
+            logger.log(id, ": Recording to ", stream.recorder.Session().string());
+        else
+            logger.err(id, ": Couldn't start recording in ", (emuDirectory / id / "recordings").string());
+    } else if (!record && stream.recorder.IsRecording()) {
+        logger.log(id, ": Stopped recording to ", stream.recorder.Session().string());
+        stream.recorder.Stop();
+    }
 }
 
-void LetsPlayServer::SendFrame(const EmuID_t& id) {
-    auto jpegData = GenerateEmuJPEG(id);
+void LetsPlayServer::BenchmarkEncoderProfiles(const EmuID_t& id, LetsPlayUserHdl user_hdl) {
+    // Copied out, a snapshot held for the whole benchmark would keep one of the mailbox's slots from the emulator
+    std::vector<std::uint8_t> pixels;
+    Frame frame;
+    {
+        std::unique_lock<std::mutex> lk(m_EmusMutex);
+        auto search = m_Emus.find(id);
+        if (search == m_Emus.end() || !search->second)
+            return;
+
+        const auto snapshot = search->second->frames->Latest();
+        const Frame &latest = snapshot.frame();
+        pixels.assign(latest.data, latest.data + std::size_t(latest.pitch) * latest.height);
+        frame = latest;
+        frame.data = pixels.data();
+    }
+
+    if (frame.width == 0 || frame.height == 0)
+        return;
 
-    // Mark as screen message
-    jpegData[0] = 0 | (kBinaryMessageType::Screen << 5);
+    const auto profiles = config.get<nlohmann::json>(nlohmann::json::value_t::object, "serverConfig",
+                                                     "encoderProfiles");
+
+    // benchmark, then a profile name, average encode time in us and size in bytes for every valid profile
+    std::vector<std::string> message{"benchmark"};
+    for (auto it = profiles.begin(); it != profiles.end(); ++it) {
+        EncoderProfile profile;
+        if (!EncoderProfile::FromJSON(it.value(), profile))
+            continue;
+
+        std::size_t bytes{0};
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < kBenchmarkRuns; ++i)
+            bytes = CompressJPEG(frame, profile, 1).size - 1;
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / kBenchmarkRuns;
+
+        logger.log(id, ": Encoder profile '", it.key(), "' (", EncoderProfile::SubsamplingName(profile.subsampling),
+                   profile.fastDCT ? " fast" : " accurate", profile.progressive ? " progressive" : "", " q",
+                   profile.quality, "): ", us, "us, ", bytes, " bytes at ", frame.width, 'x', frame.height);
+
+        message.push_back(it.key());
+        message.push_back(std::to_string(us));
+        message.push_back(std::to_string(bytes));
+    }
+
+    auto user = user_hdl.lock();
+    if (!user)
+        return;
 
     std::unique_lock<std::mutex> lk(m_UsersMutex);
     for (auto &pair : m_Users) {
-        auto &hdl = pair.first;
-        auto &user = pair.second;
+        if (pair.second == user) {
+            websocketpp::lib::error_code ec;
+            server->send(pair.first, LetsPlayProtocol::encode(message), websocketpp::frame::opcode::text, ec);
+            break;
+        }
+    }
+}
+
+void LetsPlayServer::SendFrame(const EmuID_t& id) {
+    // Possible race condition, unlocked m_EmusMutex
+    auto emu = m_Emus[id];
+
+    // If the pool hasn't picked up the previous frame yet, that one is dropped in favour of this one
+    m_Encoder.Submit(id, *emu->frames);
+}
+
+void LetsPlayServer::broadcastFrame(const EmuID_t& id, const Frame& frame, bool duplicate) {
+    // One list of full frame viewers per rendition, split by whether or not they can take lossless frames
+    thread_local static std::vector<std::vector<websocketpp::connection_hdl>> fullViewers, losslessViewers;
+    thread_local static std::vector<websocketpp::connection_hdl> deltaViewers;
+    thread_local static std::vector<bool> due;
+    thread_local static std::vector<std::pair<websocketpp::connection_hdl, std::shared_ptr<LetsPlayUser>>> replayViewers;
+    fullViewers.resize(m_Renditions.size());
+    losslessViewers.resize(m_Renditions.size());
+    for (std::size_t r = 0; r < m_Renditions.size(); ++r) {
+        fullViewers[r].clear();
+        losslessViewers[r].clear();
+    }
+    deltaViewers.clear();
+    replayViewers.clear();
+
+    const std::uint64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    EmuStream *stream = [&]() -> EmuStream * {
+        std::unique_lock<std::mutex> lk(m_StreamsMutex);
+        auto search = m_Streams.find(id);
+        return search == m_Streams.end() ? nullptr : &search->second;
+    }();
+    if (!stream)
+        return;
+
+    // Cores that don't report dupes still tend to present the same picture for a while (menus, pauses, ...)
+    bool unchanged{false};
+    if (frame.width != 0 && frame.height != 0) {
+        if (duplicate && stream->hasLastHash) {
+            unchanged = true;
+        } else {
+            const auto hash = FrameHash::Hash(frame);
+            unchanged = stream->hasLastHash && hash == stream->lastHash;
+            stream->lastHash = hash;
+            stream->hasLastHash = true;
+        }
+    } else {
+        stream->hasLastHash = false;
+    }
+
+    if (!stream->settingsLoaded)
+        refreshStreamSettings(id, *stream);
+
+    if (stream->previewRequested.exchange(false) && stream->hasLastHash)
+        updatePreview(id, frame, stream->lastHash, stream->profile);
+
+    const bool periodicKeyframe = !unchanged && ++stream->framesSinceKeyframe >= stream->keyframeInterval;
+    if (periodicKeyframe) {
+        stream->framesSinceKeyframe = 0;
+        refreshStreamSettings(id, *stream);
+    }
 
-        if (user->connectedEmu() == id && user->connected && !hdl.expired()) {
+    /* Which renditions get this frame. A changed frame that a lower fps rendition isn't due for leaves it stale, so
+     * it still gets its next turn even if nothing changes after that. */
+    const std::uint64_t frameNumber = stream->frameCount++;
+    stream->renditionStale.resize(m_Renditions.size(), false);
+    stream->jpegBytesPerPixel.resize(m_Renditions.size(), 0);
+    due.assign(m_Renditions.size(), false);
+    for (std::size_t r = 0; r < m_Renditions.size(); ++r) {
+        const bool onTime = frameNumber % m_Renditions[r].frameInterval == 0;
+        due[r] = onTime && (!unchanged || stream->renditionStale[r]);
+
+        if (due[r])
+            stream->renditionStale[r] = false;
+        else if (!unchanged)
+            stream->renditionStale[r] = true;
+    }
+
+    // Deltas are made between consecutive frames, so only a full rate, full size rendition can use them
+    const bool deltaRendition = m_Renditions[0].scale == 1 && m_Renditions[0].frameInterval == 1;
+
+    // Split viewers into who gets a full frame (of which rendition) and who can make do with what changed
+    bool anyDeltaViewers{false};
+    {
+        std::unique_lock<std::mutex> lk(m_UsersMutex);
+        for (auto &pair : m_Users) {
+            auto &hdl = pair.first;
+            auto &user = pair.second;
+
+            if (user->connectedEmu() != id || !user->connected || hdl.expired())
+                continue;
+
+            // Rewound viewers are fed from the DVR instead, after this frame is added to it
+            if (user->replayRequested.exchange(false))
+                startReplay(*user, hdl, *stream, now);
+            if (user->replaying) {
+                replayViewers.emplace_back(hdl, user);
+                continue;
+            }
+
+            std::size_t r = std::min<std::size_t>(user->rendition, m_Renditions.size() - 1);
+            if (user->supportsDelta && r == 0 && deltaRendition)
+                anyDeltaViewers = true;
+
+            // Already has this frame or isn't due for one, except whoever is waiting on a full one
+            if (!due[r] && !user->needsKeyframe)
+                continue;
+
+            // Still sending older frames: skip this one, and give them the newest full frame once they catch up
             websocketpp::lib::error_code ec;
-            server->send(hdl, jpegData.data(), jpegData.size(), websocketpp::frame::opcode::binary, ec);
+            auto cptr = server->get_con_from_hdl(hdl, ec);
+            if (ec)
+                continue;
+
+            const auto buffered = cptr->get_buffered_amount();
+            if (buffered > stream->maxBufferedBytes) {
+                ++user->framesDropped;
+                user->needsKeyframe = true;
+                user->smoothFrames = 0;
+
+                // Just fell behind, try something cheaper
+                if (user->autoRendition && !user->isBehind() && r + 1 < m_Renditions.size())
+                    setRendition(*user, hdl, r + 1);
+
+                if (user->markBehind() > stream->stallTimeout) {
+                    logger.log(user->uuid(), " (", user->username(), ") stalled, ", user->framesDropped.load(),
+                               " frames dropped. Disconnecting.");
+                    user->connected = false;
+                    server->close(hdl, websocketpp::close::status::policy_violation, "Stalled.", ec);
+                }
+                continue;
+            }
+            user->markCaughtUp();
+
+            // Kept up with plenty of room for a while, try something nicer
+            if (user->autoRendition && r > 0) {
+                if (buffered > stream->maxBufferedBytes / 4)
+                    user->smoothFrames = 0;
+                else if (++user->smoothFrames >= kRenditionStepUpFrames)
+                    setRendition(*user, hdl, --r);
+            }
+
+            if (user->supportsDelta && r == 0 && deltaRendition && !user->needsKeyframe && !periodicKeyframe) {
+                deltaViewers.push_back(hdl);
+            } else {
+                // Palettes don't survive downscaling, so lossless frames are only made at full size
+                if (user->supportsLossless && m_Renditions[r].scale == 1)
+                    losslessViewers[r].push_back(hdl);
+                else
+                    fullViewers[r].push_back(hdl);
+                user->needsKeyframe = false;
+            }
+        }
+    }
+
+    if (frame.width == 0 || frame.height == 0) {
+        // Nothing to diff against; anyone expecting deltas needs a full frame once there is one
+        stream->tiles.Reset();
+        std::move(deltaViewers.begin(), deltaViewers.end(), std::back_inserter(fullViewers[0]));
+        deltaViewers.clear();
+    } else if (anyDeltaViewers && !unchanged) {
+        // The retained copy has to follow every frame as long as someone relies on it
+        const bool comparable = stream->tiles.Update(frame);
+        if (!comparable || stream->tiles.DirtyFraction() > 0.5) {
+            // Not worth it (or not possible) to send parts of the frame
+            std::move(deltaViewers.begin(), deltaViewers.end(), std::back_inserter(fullViewers[0]));
+            deltaViewers.clear();
+        } else if (stream->tiles.DirtyFraction() == 0) {
+            // Nothing changed, delta viewers are already up to date
+            deltaViewers.clear();
+        }
+    } else if (!anyDeltaViewers) {
+        stream->tiles.Reset();
+    }
+
+    // Every rendition is encoded at most once per codec and shared by all of its viewers
+    auto &jpegMessages = stream->jpegMessages;
+    jpegMessages.resize(m_Renditions.size());
+    auto jpegMessage = [&](std::size_t r) -> const SharedMessagePool::message_ptr & {
+        if (!jpegMessages[r]) {
+            EncoderProfile profile = stream->profile;
+            if (m_Renditions[r].quality)
+                profile.quality = m_Renditions[r].quality;
+
+            const auto jpeg = CompressJPEG(frame, profile, m_Renditions[r].scale);
+
+            // One copy out of the encoder buffer into a reused payload, framed once for everyone
+            auto msg = m_FrameMessages.Acquire(websocketpp::frame::opcode::binary);
+            auto &payload = msg->get_raw_payload();
+            payload.assign(reinterpret_cast<const char *>(jpeg.data), jpeg.size);
+
+            // Mark as screen message
+            payload[0] = 0 | (kBinaryMessageType::Screen << 5);
+            SharedMessagePool::Prepare(msg);
+
+            const double pixels = double(frame.width / m_Renditions[r].scale) * (frame.height / m_Renditions[r].scale);
+            if (pixels > 0)
+                stream->jpegBytesPerPixel[r] = jpeg.size / pixels;
+
+            jpegMessages[r] = msg;
+        }
+        return jpegMessages[r];
+    };
+
+    // The archive gets the exact bytes the top rendition's viewers get, so recording never encodes anything extra
+    if (stream->recorder.IsRecording() && !unchanged && frame.width != 0 && frame.height != 0) {
+        const auto &payload = jpegMessage(0)->get_payload();
+        const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+        if (!stream->recorder.Append(reinterpret_cast<const std::uint8_t *>(payload.data()) + 1, payload.size() - 1,
+                                     now))
+            logger.err(id, ": Couldn't add a frame to recording ", stream->recorder.Session().string());
+    }
+
+    /* Kept with the header byte, so a DVR frame goes out exactly as it's stored. Like recording, this makes a full
+     * size encode of every changed frame whether or not anyone watches that rendition, which is why the DVR is off
+     * (dvr.bufferSize 0) unless configured. */
+    if (stream->dvr.Enabled() && !unchanged && frame.width != 0 && frame.height != 0) {
+        const auto &payload = jpegMessage(0)->get_payload();
+        stream->dvr.Append(reinterpret_cast<const std::uint8_t *>(payload.data()), payload.size(), now);
+    }
+
+    if (!replayViewers.empty())
+        serveReplays(*stream, replayViewers, now);
+
+    for (std::size_t r = 0; r < m_Renditions.size(); ++r) {
+        if (!losslessViewers[r].empty()) {
+            /* Lossless only works at all on frames with few colours, and the run length coded size doubles as a
+             * measure of how busy the frame is. It's sent if it comes out no bigger than a jpeg of this rendition
+             * would be (going by the last one made), since it's cheaper to make and pixel exact. */
+            auto msg = m_FrameMessages.Acquire(websocketpp::frame::opcode::binary);
+            auto &payload = msg->get_raw_payload();
+            payload.push_back(static_cast<char>(0 | (kBinaryMessageType::LosslessScreen << 5)));
+
+            bool useLossless = LosslessCodec::Encode(frame, payload);
+            if (useLossless) {
+                if (stream->jpegBytesPerPixel[r] == 0)
+                    jpegMessage(r);
+
+                useLossless = payload.size() <= stream->jpegBytesPerPixel[r] * frame.width * frame.height;
+            }
+
+            if (useLossless) {
+                SharedMessagePool::Prepare(msg);
+                sendShared(losslessViewers[r], msg);
+            } else {
+                std::move(losslessViewers[r].begin(), losslessViewers[r].end(),
+                          std::back_inserter(fullViewers[r]));
+            }
         }
+
+        if (!fullViewers[r].empty())
+            sendShared(fullViewers[r], jpegMessage(r));
+    }
+
+    if (!deltaViewers.empty()) {
+        auto msg = m_FrameMessages.Acquire(websocketpp::frame::opcode::binary);
+        EncoderProfile profile = stream->profile;
+        if (m_Renditions[0].quality)
+            profile.quality = m_Renditions[0].quality;
+
+        encodeDeltaFrame(frame, stream->tiles, profile, msg->get_raw_payload());
+        SharedMessagePool::Prepare(msg);
+
+        sendShared(deltaViewers, msg);
     }
+
+    // Hand the messages back to the pool, the slots stay for the next frame
+    std::fill(jpegMessages.begin(), jpegMessages.end(), nullptr);
+}
+
+void LetsPlayServer::startReplay(LetsPlayUser& user, websocketpp::connection_hdl hdl, const EmuStream& stream,
+                                 std::uint64_t now) {
+    websocketpp::lib::error_code ec;
+    const auto offset = std::min(user.replayOffset.load(), stream.dvr.MaxAge());
+
+    if (offset == 0 || !stream.dvr.Enabled()) {
+        if (user.replaying) {
+            user.replaying = false;
+            user.needsKeyframe = true;
+        }
+        server->send(hdl, LetsPlayProtocol::encode("live"), websocketpp::frame::opcode::text, ec);
+        return;
+    }
+
+    user.replayFrom = now - offset;
+    user.replayStartedAt = now;
+    user.replayLastSequence = 0;
+    user.replaying = true;
+    server->send(hdl, LetsPlayProtocol::encode("replay", offset), websocketpp::frame::opcode::text, ec);
+}
+
+void LetsPlayServer::serveReplays(const EmuStream& stream,
+                                  const std::vector<std::pair<websocketpp::connection_hdl,
+                                                              std::shared_ptr<LetsPlayUser>>>& viewers,
+                                  std::uint64_t now) {
+    // Viewers watching the same moment share one message
+    std::vector<std::pair<std::uint64_t, SharedMessagePool::message_ptr>> sent;
+
+    DvrEntry newest;
+    const bool any = stream.dvr.Newest(newest);
+
+    for (const auto &viewer : viewers) {
+        const auto &hdl = viewer.first;
+        auto &user = *viewer.second;
+
+        websocketpp::lib::error_code ec;
+        auto cptr = server->get_con_from_hdl(hdl, ec);
+        if (ec)
+            continue;
+
+        // Playback goes on at normal speed from where it started, so anyone who paused too long skips ahead
+        const std::uint64_t position = user.replayFrom + (now - user.replayStartedAt);
+        if (!any || position >= newest.time) {
+            user.replaying = false;
+            user.needsKeyframe = true;
+            server->send(hdl, LetsPlayProtocol::encode("live"), websocketpp::frame::opcode::text, ec);
+            continue;
+        }
+
+        // Same as live viewers: don't pile frames onto a connection that's still busy
+        if (cptr->get_buffered_amount() > stream.maxBufferedBytes)
+            continue;
+
+        DvrEntry entry;
+        stream.dvr.Find(position, entry);
+        if (entry.sequence == user.replayLastSequence)
+            continue;
+        user.replayLastSequence = entry.sequence;
+
+        auto search = std::find_if(sent.begin(), sent.end(), [&](const auto &s) { return s.first == entry.sequence; });
+        if (search == sent.end()) {
+            auto msg = m_FrameMessages.Acquire(websocketpp::frame::opcode::binary);
+            msg->get_raw_payload().assign(reinterpret_cast<const char *>(stream.dvr.Data(entry)), entry.size);
+            SharedMessagePool::Prepare(msg);
+            sent.emplace_back(entry.sequence, msg);
+            search = sent.end() - 1;
+        }
+
+        sendShared({hdl}, search->second);
+    }
+}
+
+void LetsPlayServer::updatePreview(const EmuID_t& id, const Frame& frame, std::uint64_t hash, EncoderProfile profile) {
+    const auto width = std::max<std::uint64_t>(1, config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned,
+                                                                             "serverConfig", "previews", "width"));
+    profile.quality = std::min<unsigned>(100, config.get<std::uint64_t>(nlohmann::json::value_t::number_unsigned,
+                                                                        "serverConfig", "previews", "quality"));
+
+    // Smallest whole factor that brings the frame down to the thumbnail width
+    const unsigned scale = static_cast<unsigned>((frame.width + width - 1) / width);
+
+    std::ostringstream etag;
+    etag << '"' << std::hex << hash << '-' << std::dec << scale << 'q' << profile.quality << '"';
+
+    {
+        std::unique_lock<std::mutex> lk(m_PreviewsMutex);
+        auto search = m_Previews.find(id);
+        if (search != m_Previews.end() && search->second.etag == etag.str())
+            return;
+    }
+
+    std::uint8_t index;
+    {
+        std::unique_lock<std::mutex> lk(m_EmusMutex);
+        index = static_cast<std::uint8_t>(std::distance(m_Emus.begin(), m_Emus.find(id)));
+    }
+
+    const auto jpeg = CompressJPEG(frame, profile, scale);
+
+    EmuPreview preview;
+    preview.message.assign(jpeg.data, jpeg.data + jpeg.size);
+    preview.message[0] = index | (kBinaryMessageType::Preview << 5);
+    preview.etag = etag.str();
+
+    std::unique_lock<std::mutex> lk(m_PreviewsMutex);
+    m_Previews[id] = std::move(preview);
+}
+
+void LetsPlayServer::setRendition(LetsPlayUser& user, websocketpp::connection_hdl hdl, std::size_t rendition) {
+    const auto &r = m_Renditions[rendition];
+    user.rendition = rendition;
+    user.smoothFrames = 0;
+    user.needsKeyframe = true;
+
+    websocketpp::lib::error_code ec;
+    server->send(hdl, LetsPlayProtocol::encode("rendition", r.name, r.scale), websocketpp::frame::opcode::text, ec);
+}
+
+void LetsPlayServer::loadRenditions() {
+    const auto ladder = config.get<nlohmann::json>(nlohmann::json::value_t::array, "serverConfig", "renditions");
+
+    m_Renditions.clear();
+    for (const auto &entry : ladder) {
+        if (!entry.is_object())
+            continue;
+
+        Rendition r;
+        r.name = entry.value("name", std::string{});
+        r.scale = entry.value("scale", 1u);
+        r.quality = entry.value("quality", 0u);
+        r.frameInterval = entry.value("frameInterval", std::uint64_t{1});
+
+        if (r.name.empty() || r.scale < 1 || r.scale > 8 || r.quality > 100 || r.frameInterval < 1) {
+            logger.err("Skipping invalid rendition '", r.name, "' in config.");
+            continue;
+        }
+
+        m_Renditions.push_back(r);
+    }
+
+    if (m_Renditions.empty())
+        m_Renditions.push_back(Rendition{"full", 1, 0, 1});
+}
+
+void LetsPlayServer::encodeDeltaFrame(const Frame& frame, const DirtyTileTracker& tiles,
+                                      const EncoderProfile& profile, std::string& payload) {
+    /* Layout (all integers little endian):
+     *  u8 header, u16 frame width, u16 frame height, u16 rect count,
+     *  then per rect: u16 x, u16 y, u16 width, u16 height, u32 jpeg size, jpeg data */
+    const auto rects = tiles.DirtyRects();
+    const std::size_t bpp = PixelConversion::BytesPerPixel(frame.format);
+
+    payload.push_back(static_cast<char>(0 | (kBinaryMessageType::DeltaScreen << 5)));
+    appendLittleEndian(payload, frame.width, 2);
+    appendLittleEndian(payload, frame.height, 2);
+    appendLittleEndian(payload, rects.size(), 2);
+
+    for (const auto &rect : rects) {
+        const Frame window{rect.width, rect.height, frame.pitch,
+                           frame.data + std::size_t(rect.y) * frame.pitch + rect.x * bpp, frame.format};
+        const auto jpeg = CompressJPEG(window, profile, 1);
+
+        appendLittleEndian(payload, rect.x, 2);
+        appendLittleEndian(payload, rect.y, 2);
+        appendLittleEndian(payload, rect.width, 2);
+        appendLittleEndian(payload, rect.height, 2);
+        appendLittleEndian(payload, jpeg.size - 1, 4);
+        payload.append(reinterpret_cast<const char *>(jpeg.data) + 1, jpeg.size - 1);
+    }
+}
+
+void LetsPlayServer::sendShared(const std::vector<websocketpp::connection_hdl>& hdls,
+                                const SharedMessagePool::message_ptr& msg) {
+    for (const auto &hdl : hdls) {
+        websocketpp::lib::error_code ec;
+        auto cptr = server->get_con_from_hdl(hdl, ec);
+        if (ec)
+            continue;
+
+        if (SharedMessagePool::CanSendPrepared(cptr->get_version()))
+            server->send(hdl, msg, ec);
+        else
+            server->send(hdl, msg->get_payload().data(), msg->get_payload().size(), msg->get_opcode(), ec);
+    }
+}
+
+void LetsPlayServer::appendLittleEndian(std::string& out, std::uint32_t value, std::size_t bytes) {
+    for (std::size_t i = 0; i < bytes; ++i)
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
 }
 
 std::string LetsPlayServer::escapeTilde(std::string str) {
@@ -11,7 +11,17 @@ LetsPlayUser::LetsPlayUser()
       hasTurn{false},
       requestedTurn{false},
       connected{true},
-      hasAdmin{false} {
+      hasAdmin{false},
+      supportsDelta{false},
+      needsKeyframe{true},
+      supportsLossless{false},
+      framesDropped{0},
+      rendition{0},
+      autoRendition{true},
+      smoothFrames{0},
+      replayOffset{0},
+      replayRequested{false},
+      replaying{false} {
     g_uuidMutex.lock();
     m_uuid = g_UUIDGen();
     g_uuidMutex.unlock();
@@ -23,6 +33,27 @@ bool LetsPlayUser::shouldDisconnect() {
         (m_lastPong + std::chrono::seconds(10));
 }
 
+std::chrono::milliseconds LetsPlayUser::markBehind() {
+    std::unique_lock<std::mutex> lk(m_flow);
+    const auto now = std::chrono::steady_clock::now();
+    if (!m_behind) {
+        m_behind = true;
+        m_behindSince = now;
+    }
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now - m_behindSince);
+}
+
+void LetsPlayUser::markCaughtUp() {
+    std::unique_lock<std::mutex> lk(m_flow);
+    m_behind = false;
+}
+
+bool LetsPlayUser::isBehind() {
+    std::unique_lock<std::mutex> lk(m_flow);
+    return m_behind;
+}
+
 void LetsPlayUser::updateLastPong() {
     std::unique_lock<std::mutex> lk(m_access);
     m_lastPong = std::chrono::steady_clock::now();
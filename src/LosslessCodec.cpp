@@ -0,0 +1,142 @@
+#include "LosslessCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "PixelConversion.h"
+
+namespace LosslessCodec {
+    /**
+     * Longest run a single op can describe
+     */
+    static constexpr std::size_t kMaxRun = 64;
+
+    enum kOp : std::uint8_t {
+        Literal = 0x00,
+        Repeat = 0x40,
+        CopyAbove = 0x80,
+    };
+
+    static void appendU16(std::string &out, std::uint32_t value) {
+        out.push_back(static_cast<char>(value & 0xFF));
+        out.push_back(static_cast<char>((value >> 8) & 0xFF));
+    }
+
+    /**
+     * Maps every pixel to a palette index.
+     *
+     * @return false if there are more than kMaxColours colours
+     */
+    static bool buildPalette(const Frame &frame, std::vector<std::uint8_t> &indices,
+                             std::vector<std::uint16_t> &palette) {
+        /* Lookup from colour to index, entries are (generation << 8) | index so the table doesn't have to be cleared
+         * for every frame */
+        thread_local static std::vector<std::uint32_t> lookup(65536, 0);
+        thread_local static std::uint32_t generation{0};
+
+        if (++generation == (1u << 24)) {
+            std::fill(lookup.begin(), lookup.end(), 0);
+            generation = 1;
+        }
+
+        palette.clear();
+        indices.resize(std::size_t(frame.width) * frame.height);
+
+        std::uint8_t *out = indices.data();
+        for (std::uint32_t y = 0; y < frame.height; ++y) {
+            const std::uint8_t *row = frame.data + std::size_t(y) * frame.pitch;
+            for (std::uint32_t x = 0; x < frame.width; ++x) {
+                std::uint16_t colour;
+                std::memcpy(&colour, row + 2 * x, sizeof(colour));
+
+                std::uint32_t &entry = lookup[colour];
+                if ((entry >> 8) != generation) {
+                    if (palette.size() == kMaxColours)
+                        return false;
+
+                    entry = (generation << 8) | palette.size();
+                    palette.push_back(colour);
+                }
+
+                *out++ = static_cast<std::uint8_t>(entry & 0xFF);
+            }
+        }
+
+        return true;
+    }
+
+    static void flushLiterals(std::string &out, const std::uint8_t *start, std::size_t count) {
+        while (count) {
+            const std::size_t n = std::min(count, kMaxRun);
+            out.push_back(static_cast<char>(kOp::Literal | (n - 1)));
+            out.append(reinterpret_cast<const char *>(start), n);
+            start += n;
+            count -= n;
+        }
+    }
+}
+
+bool LosslessCodec::Encode(const Frame &frame, std::string &out) {
+    thread_local static std::vector<std::uint8_t> indices;
+    thread_local static std::vector<std::uint16_t> palette;
+    thread_local static std::vector<std::uint32_t> rgb;
+
+    if (frame.format == RETRO_PIXEL_FORMAT_XRGB8888 || frame.width == 0 || frame.height == 0 ||
+        frame.width > 0xFFFF || frame.height > 0xFFFF)
+        return false;
+
+    if (!buildPalette(frame, indices, palette))
+        return false;
+
+    appendU16(out, frame.width);
+    appendU16(out, frame.height);
+    appendU16(out, palette.size());
+
+    // Expand the palette with the same kernels the jpeg path uses, so both paths agree on colours
+    rgb.resize(palette.size());
+    PixelConversion::XRGB8888Converter(frame.format)(reinterpret_cast<const std::uint8_t *>(palette.data()),
+                                                     reinterpret_cast<std::uint8_t *>(rgb.data()), palette.size());
+    for (const auto colour : rgb) {
+        out.push_back(static_cast<char>((colour >> 16) & 0xFF));
+        out.push_back(static_cast<char>((colour >> 8) & 0xFF));
+        out.push_back(static_cast<char>(colour & 0xFF));
+    }
+
+    const std::uint8_t *idx = indices.data();
+    const std::size_t count = indices.size(), width = frame.width;
+    std::size_t literalStart = 0, literals = 0;
+
+    for (std::size_t i = 0; i < count;) {
+        std::size_t above = 0;
+        if (i >= width)
+            while (above < kMaxRun && i + above < count && idx[i + above] == idx[i + above - width])
+                ++above;
+
+        std::size_t run = 1;
+        while (run < kMaxRun && i + run < count && idx[i + run] == idx[i])
+            ++run;
+
+        // A copy costs one byte and a repeat two, anything shorter is cheaper to keep as part of a literal
+        if (above >= 2 && above >= run) {
+            flushLiterals(out, idx + literalStart, literals);
+            literals = 0;
+            out.push_back(static_cast<char>(kOp::CopyAbove | (above - 1)));
+            i += above;
+        } else if (run >= 3) {
+            flushLiterals(out, idx + literalStart, literals);
+            literals = 0;
+            out.push_back(static_cast<char>(kOp::Repeat | (run - 1)));
+            out.push_back(static_cast<char>(idx[i]));
+            i += run;
+        } else {
+            if (!literals)
+                literalStart = i;
+            ++literals;
+            ++i;
+        }
+    }
+    flushLiterals(out, idx + literalStart, literals);
+
+    return true;
+}
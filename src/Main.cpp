@@ -5,6 +5,7 @@
 
 #include <boost/program_options.hpp>
 
+#include "CoreHost.h"
 #include "EmulatorController.h"
 #include "LetsPlayServer.h"
 #include "RetroCore.h"
@@ -31,12 +32,16 @@ int main(int argc, char **argv) {
         // clang-format off
         desc.add_options()("help,h", "Help")
             ("config", program_options::value<std::string>(), "Config file path")
-            ("port", program_options::value<std::uint16_t>(), "Port to run the server on");
+            ("port", program_options::value<std::uint16_t>(), "Port to run the server on")
+            ("core-host", program_options::value<int>(), "Internal: run an isolated core using the given shared memory fd");
         // clang-format on
 
         program_options::variables_map vm;
         program_options::store(program_options::parse_command_line(argc, argv, desc), vm);
 
+        if (vm.count("core-host"))
+            return CoreHost::ChildMain(vm["core-host"].as<int>());
+
         if (vm.count("help")) {
             std::cout << desc << '\n';
             return 0;
@@ -0,0 +1,150 @@
+#include "MappedFile.h"
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        Close();
+        std::swap(m_fd, other.m_fd);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_writable, other.m_writable);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Create(const boost::filesystem::path &path, std::size_t capacity) {
+    Close();
+    if (capacity == 0)
+        return false;
+
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+        return false;
+
+    // Reserve the blocks now: running out of disk later would be a SIGBUS in the middle of a memcpy
+    if (::posix_fallocate(m_fd, 0, static_cast<off_t>(capacity)) != 0) {
+        Close();
+        ::unlink(path.c_str());
+        return false;
+    }
+
+    void *data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    m_data = static_cast<std::uint8_t *>(data);
+    m_size = 0;
+    m_capacity = capacity;
+    m_writable = true;
+    return true;
+}
+
+bool MappedFile::Open(const boost::filesystem::path &path) {
+    Close();
+
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+        return false;
+
+    struct stat st{};
+    if (::fstat(m_fd, &st) != 0 || st.st_size <= 0) {
+        Close();
+        return false;
+    }
+
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void *data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (data == MAP_FAILED) {
+        Close();
+        return false;
+    }
+
+    m_data = static_cast<std::uint8_t *>(data);
+    m_size = m_capacity = size;
+    m_writable = false;
+    return true;
+}
+
+std::shared_ptr<const MappedFile> MappedFile::OpenShared(const boost::filesystem::path &path) {
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<const MappedFile>> open;
+
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0)
+        return nullptr;
+
+    const auto key = std::to_string(st.st_dev) + ':' + std::to_string(st.st_ino) + ':' +
+                     std::to_string(st.st_size) + ':' + std::to_string(st.st_mtime);
+
+    std::unique_lock<std::mutex> lk(mutex);
+    if (auto file = open[key].lock())
+        return file;
+
+    auto file = std::make_shared<MappedFile>();
+    if (!file->Open(path)) {
+        open.erase(key);
+        return nullptr;
+    }
+
+    // Forget files nobody has open anymore
+    for (auto it = open.begin(); it != open.end();) {
+        if (it->second.expired())
+            it = open.erase(it);
+        else
+            ++it;
+    }
+
+    open[key] = file;
+    return file;
+}
+
+bool MappedFile::Append(const void *data, std::size_t size, std::size_t &offset) {
+    if (!m_writable || size > m_capacity - m_size)
+        return false;
+
+    offset = m_size;
+    std::memcpy(m_data + m_size, data, size);
+    m_size += size;
+    return true;
+}
+
+void MappedFile::Close() {
+    if (m_data) {
+        if (m_writable)
+            ::msync(m_data, m_capacity, MS_ASYNC);
+        ::munmap(m_data, m_capacity);
+    }
+
+    if (m_fd >= 0) {
+        // Drop the unused, zeroed tail that was reserved up front
+        if (m_writable && m_data)
+            (void) ::ftruncate(m_fd, static_cast<off_t>(m_size));
+        ::close(m_fd);
+    }
+
+    m_fd = -1;
+    m_data = nullptr;
+    m_size = m_capacity = 0;
+    m_writable = false;
+}
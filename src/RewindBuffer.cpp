@@ -0,0 +1,133 @@
+#include "RewindBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+constexpr std::size_t RewindBuffer::kMinZeroRun;
+
+namespace {
+    void putVarint(std::string &out, std::size_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    std::size_t getVarint(const std::string &in, std::size_t &pos) {
+        std::size_t value = 0;
+        for (unsigned shift = 0; pos < in.size(); shift += 7) {
+            const auto byte = static_cast<unsigned char>(in[pos++]);
+            value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        return value;
+    }
+
+    /**
+     * Index of the first byte from i on where a and b differ, or size
+     */
+    std::size_t skipEqual(const unsigned char *a, const unsigned char *b, std::size_t i, std::size_t size) {
+        // Word at a time, most of a state doesn't change between captures
+        for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+            std::uint64_t x, y;
+            std::memcpy(&x, a + i, sizeof x);
+            std::memcpy(&y, b + i, sizeof y);
+            if (x != y)
+                break;
+        }
+
+        while (i < size && a[i] == b[i])
+            ++i;
+        return i;
+    }
+}
+
+void RewindBuffer::Configure(std::size_t maxBytes) {
+    m_MaxBytes = maxBytes;
+    while (!m_Deltas.empty() && m_Bytes > m_MaxBytes) {
+        m_Bytes -= m_Deltas.front().size();
+        m_Deltas.pop_front();
+    }
+}
+
+void RewindBuffer::Push(const unsigned char *state, std::size_t size) {
+    if (size != m_Newest.size()) {
+        Clear();
+    } else {
+        std::string delta;
+        encodeDelta(m_Newest.data(), state, size, delta);
+        delta.shrink_to_fit();
+
+        m_Bytes += delta.size();
+        m_Deltas.push_back(std::move(delta));
+        Configure(m_MaxBytes);
+    }
+
+    m_Newest.assign(state, state + size);
+}
+
+std::size_t RewindBuffer::Rewind(std::size_t steps, std::vector<unsigned char> &out) {
+    steps = std::min(steps, m_Deltas.size());
+    for (std::size_t i = 0; i < steps; ++i) {
+        applyDelta(m_Deltas.back(), m_Newest.data(), m_Newest.size());
+        m_Bytes -= m_Deltas.back().size();
+        m_Deltas.pop_back();
+    }
+
+    out = m_Newest;
+    return steps;
+}
+
+void RewindBuffer::Clear() {
+    m_Newest.clear();
+    m_Deltas.clear();
+    m_Bytes = 0;
+}
+
+void RewindBuffer::encodeDelta(const unsigned char *a, const unsigned char *b, std::size_t size, std::string &out) {
+    std::size_t i = 0;
+    while (i < size) {
+        const std::size_t start = skipEqual(a, b, i, size);
+        if (start == size)
+            break;
+
+        // Changed bytes up to the next long enough run of equal ones
+        std::size_t end = start;
+        while (end < size) {
+            if (a[end] != b[end]) {
+                ++end;
+                continue;
+            }
+
+            const std::size_t next = skipEqual(a, b, end, std::min(size, end + kMinZeroRun));
+            if (next - end >= kMinZeroRun || next == size)
+                break;
+            end = next;
+        }
+
+        putVarint(out, start - i);
+        putVarint(out, end - start);
+        for (std::size_t j = start; j < end; ++j)
+            out.push_back(static_cast<char>(a[j] ^ b[j]));
+
+        i = end;
+    }
+}
+
+void RewindBuffer::applyDelta(const std::string &delta, unsigned char *state, std::size_t size) {
+    std::size_t pos = 0, i = 0;
+    while (pos < delta.size()) {
+        i += getVarint(delta, pos);
+        const std::size_t count = getVarint(delta, pos);
+        if (i + count > size || pos + count > delta.size())
+            return;
+
+        for (std::size_t j = 0; j < count; ++j)
+            state[i + j] ^= static_cast<unsigned char>(delta[pos + j]);
+
+        i += count;
+        pos += count;
+    }
+}
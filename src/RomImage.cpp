@@ -0,0 +1,531 @@
+#include "RomImage.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+#ifdef LETSPLAY_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+    enum class kRomFormat {
+        Plain,
+        Zip,
+        Gzip,
+        Zstd,
+    };
+
+    /**
+     * What's in an archive and where
+     */
+    struct ArchiveEntry {
+        kRomFormat format{kRomFormat::Plain};
+
+        /**
+         * Compressed data (for zip, just the entry's)
+         */
+        const std::uint8_t *data{nullptr};
+        std::size_t size{0};
+
+        /**
+         * Name of the rom inside the archive
+         */
+        std::string name;
+
+        /**
+         * Identifies the content, used as the cache key and extraction directory name
+         */
+        std::string key;
+
+        /**
+         * Decompressed size if the archive says, 0 otherwise
+         */
+        std::uint64_t decompressedSize{0};
+
+        /**
+         * zip only: compression method and the CRC-32 of the decompressed data
+         */
+        std::uint16_t method{0};
+        std::uint32_t crc{0};
+    };
+
+    /**
+     * Gets decompressed data as it comes out
+     */
+    using Sink = std::function<bool(const std::uint8_t *, std::size_t)>;
+
+    constexpr std::size_t kChunkSize = 256 * 1024;
+
+    std::uint16_t le16(const std::uint8_t *p) {
+        return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    std::uint32_t le32(const std::uint8_t *p) {
+        return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+               (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    std::string hex32(std::uint32_t value) {
+        char buffer[9];
+        std::snprintf(buffer, sizeof buffer, "%08x", value);
+        return buffer;
+    }
+
+    kRomFormat detect(const std::uint8_t *data, std::size_t size) {
+        if (size >= 4 && le32(data) == 0x04034b50)
+            return kRomFormat::Zip;
+        if (size >= 18 && data[0] == 0x1f && data[1] == 0x8b)
+            return kRomFormat::Gzip;
+        if (size >= 4 && le32(data) == 0xfd2fb528)
+            return kRomFormat::Zstd;
+        return kRomFormat::Plain;
+    }
+
+    /**
+     * Name of the rom in an archive that doesn't store one: the archive's name minus the compression extension
+     */
+    std::string stripExtension(const boost::filesystem::path &path) {
+        return path.stem().string();
+    }
+
+    /**
+     * Finds the first file in a zip through its central directory
+     */
+    bool describeZip(const std::uint8_t *data, std::size_t size, ArchiveEntry &entry, std::string &error) {
+        // End of central directory record: 22 bytes plus a comment of up to 64k at the very end
+        const std::size_t lowest = size > 22 + 0xFFFF ? size - 22 - 0xFFFF : 0;
+        std::size_t eocd = size >= 22 ? size - 22 : 0;
+        while (eocd > lowest && le32(data + eocd) != 0x06054b50)
+            --eocd;
+        if (size < 22 || le32(data + eocd) != 0x06054b50) {
+            error = "no zip central directory found";
+            return false;
+        }
+
+        const std::uint16_t count = le16(data + eocd + 10);
+        std::size_t offset = le32(data + eocd + 16);
+
+        for (std::uint16_t i = 0; i < count; ++i) {
+            if (offset + 46 > size || le32(data + offset) != 0x02014b50) {
+                error = "corrupt zip central directory";
+                return false;
+            }
+
+            const auto *header = data + offset;
+            const std::uint16_t flags = le16(header + 8);
+            const std::uint16_t nameLength = le16(header + 28);
+            const std::size_t next = offset + 46 + nameLength + le16(header + 30) + le16(header + 32);
+            if (offset + 46 + nameLength > size) {
+                error = "corrupt zip central directory";
+                return false;
+            }
+
+            std::string name(reinterpret_cast<const char *>(header + 46), nameLength);
+            offset = next;
+            if (name.empty() || name.back() == '/') // Directory
+                continue;
+
+            const std::uint32_t compressedSize = le32(header + 20), decompressedSize = le32(header + 24),
+                    localOffset = le32(header + 42);
+            if (compressedSize == 0xFFFFFFFF || decompressedSize == 0xFFFFFFFF || localOffset == 0xFFFFFFFF) {
+                error = "zip64 archives aren't supported";
+                return false;
+            }
+            if (flags & 1) {
+                error = "encrypted zip archives aren't supported";
+                return false;
+            }
+
+            entry.method = le16(header + 10);
+            if (entry.method != 0 && entry.method != 8) {
+                error = "zip compression method " + std::to_string(entry.method) + " isn't supported";
+                return false;
+            }
+
+            // The local header's name and extra field lengths can differ from the central directory's
+            if (std::size_t(localOffset) + 30 > size || le32(data + localOffset) != 0x04034b50) {
+                error = "corrupt zip local header";
+                return false;
+            }
+            const std::size_t start = localOffset + 30 + le16(data + localOffset + 26) + le16(data + localOffset + 28);
+            if (start + compressedSize > size) {
+                error = "truncated zip archive";
+                return false;
+            }
+
+            entry.data = data + start;
+            entry.size = compressedSize;
+            entry.name = name;
+            entry.crc = le32(header + 16);
+            entry.decompressedSize = decompressedSize;
+            entry.key = "zip-" + hex32(entry.crc) + '-' + std::to_string(decompressedSize);
+            return true;
+        }
+
+        error = "the zip archive has no files";
+        return false;
+    }
+
+    bool describe(kRomFormat format, const boost::filesystem::path &path, const MappedFile &file,
+                  ArchiveEntry &entry, std::string &error) {
+        entry.format = format;
+        entry.data = file.Data();
+        entry.size = file.Size();
+
+        switch (format) {
+            case kRomFormat::Zip:
+                return describeZip(file.Data(), file.Size(), entry, error);
+            case kRomFormat::Gzip: {
+                const auto *data = file.Data();
+                entry.name = stripExtension(path);
+
+                // Original file name, if stored (FNAME after the optional FEXTRA)
+                if (data[3] & 0x08) {
+                    std::size_t offset = 10;
+                    if (data[3] & 0x04)
+                        offset += 2 + le16(data + 10);
+                    const std::size_t start = offset;
+                    while (offset < file.Size() && data[offset])
+                        ++offset;
+                    if (offset < file.Size() && offset > start)
+                        entry.name.assign(reinterpret_cast<const char *>(data + start), offset - start);
+                }
+
+                // The trailer has the CRC-32 and size (mod 2^32) of the content
+                const auto *trailer = data + file.Size() - 8;
+                entry.decompressedSize = le32(trailer + 4);
+                entry.key = "gz-" + hex32(le32(trailer)) + '-' + std::to_string(entry.decompressedSize) + '-' +
+                            std::to_string(file.Size());
+                return true;
+            }
+            case kRomFormat::Zstd: {
+#ifdef LETSPLAY_HAVE_ZSTD
+                entry.name = stripExtension(path);
+
+                const auto contentSize = ZSTD_getFrameContentSize(file.Data(), file.Size());
+                if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN && contentSize != ZSTD_CONTENTSIZE_ERROR)
+                    entry.decompressedSize = contentSize;
+
+                // The content checksum is optional in zstd, so the file itself identifies the content
+                struct stat st{};
+                if (::stat(path.c_str(), &st) != 0) {
+                    error = "couldn't stat " + path.string();
+                    return false;
+                }
+                entry.key = "zst-" + std::to_string(st.st_dev) + '-' + std::to_string(st.st_ino) + '-' +
+                            std::to_string(st.st_size) + '-' + std::to_string(st.st_mtime);
+                return true;
+#else
+                error = "zstd roms aren't supported by this build";
+                return false;
+#endif
+            }
+            case kRomFormat::Plain:
+                break;
+        }
+        return true;
+    }
+
+    /**
+     * Inflates gzip (windowBits 16 + 15, every member in turn) or raw deflate (windowBits -15)
+     */
+    bool inflateStream(const std::uint8_t *data, std::size_t size, int windowBits, const Sink &sink,
+                       std::string &error) {
+        z_stream stream{};
+        if (inflateInit2(&stream, windowBits) != Z_OK) {
+            error = "couldn't initialize zlib";
+            return false;
+        }
+
+        std::vector<std::uint8_t> chunk(kChunkSize);
+        bool ok = true;
+        int status = Z_OK;
+        while (ok) {
+            if (stream.avail_in == 0 && size > 0) {
+                const auto feed = static_cast<uInt>(std::min<std::size_t>(size, 1u << 30));
+                stream.next_in = const_cast<Bytef *>(data);
+                stream.avail_in = feed;
+                data += feed;
+                size -= feed;
+            }
+
+            stream.next_out = chunk.data();
+            stream.avail_out = static_cast<uInt>(chunk.size());
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                error = std::string("corrupt compressed data: ") + (stream.msg ? stream.msg : "unknown error");
+                ok = false;
+                break;
+            }
+
+            const std::size_t produced = chunk.size() - stream.avail_out;
+            if (produced && !sink(chunk.data(), produced)) {
+                error = "couldn't store the decompressed rom";
+                ok = false;
+                break;
+            }
+
+            if (status == Z_STREAM_END) {
+                // Concatenated gzip members make up one file, anything else after the end is ignored
+                if (windowBits > 15 && (stream.avail_in > 0 || size > 0) && inflateReset(&stream) == Z_OK)
+                    continue;
+                break;
+            }
+
+            if (status == Z_BUF_ERROR && stream.avail_in == 0 && size == 0) {
+                error = "truncated compressed data";
+                ok = false;
+            }
+        }
+
+        inflateEnd(&stream);
+        return ok;
+    }
+
+#ifdef LETSPLAY_HAVE_ZSTD
+    bool zstdStream(const std::uint8_t *data, std::size_t size, const Sink &sink, std::string &error) {
+        ZSTD_DStream *stream = ZSTD_createDStream();
+        if (!stream) {
+            error = "couldn't initialize zstd";
+            return false;
+        }
+
+        std::vector<std::uint8_t> chunk(ZSTD_DStreamOutSize());
+        ZSTD_inBuffer in{data, size, 0};
+        std::size_t status = 1;
+        bool ok = true;
+        while (ok && in.pos < in.size) {
+            ZSTD_outBuffer out{chunk.data(), chunk.size(), 0};
+            status = ZSTD_decompressStream(stream, &out, &in);
+            if (ZSTD_isError(status)) {
+                error = std::string("corrupt compressed data: ") + ZSTD_getErrorName(status);
+                ok = false;
+            } else if (out.pos && !sink(chunk.data(), out.pos)) {
+                error = "couldn't store the decompressed rom";
+                ok = false;
+            }
+        }
+
+        // Flush whatever is still buffered
+        while (ok && status != 0) {
+            ZSTD_outBuffer out{chunk.data(), chunk.size(), 0};
+            status = ZSTD_decompressStream(stream, &out, &in);
+            if (ZSTD_isError(status) || out.pos == 0) {
+                error = "truncated compressed data";
+                ok = false;
+            } else if (!sink(chunk.data(), out.pos)) {
+                error = "couldn't store the decompressed rom";
+                ok = false;
+            }
+        }
+
+        ZSTD_freeDStream(stream);
+        return ok;
+    }
+#endif
+
+    bool decompress(const ArchiveEntry &entry, const Sink &sink, std::string &error) {
+        switch (entry.format) {
+            case kRomFormat::Zip: {
+                if (entry.method == 0)
+                    return sink(entry.data, entry.size);
+
+                // zip only stores the CRC, zlib doesn't check it for raw deflate
+                uLong crc = crc32(0, Z_NULL, 0);
+                const Sink checked = [&](const std::uint8_t *data, std::size_t size) {
+                    crc = crc32_z(crc, data, size);
+                    return sink(data, size);
+                };
+                if (!inflateStream(entry.data, entry.size, -MAX_WBITS, checked, error))
+                    return false;
+                if (crc != entry.crc) {
+                    error = "CRC mismatch in the zip archive";
+                    return false;
+                }
+                return true;
+            }
+            case kRomFormat::Gzip:
+                return inflateStream(entry.data, entry.size, 16 + MAX_WBITS, sink, error);
+            case kRomFormat::Zstd:
+#ifdef LETSPLAY_HAVE_ZSTD
+                return zstdStream(entry.data, entry.size, sink, error);
+#else
+                break;
+#endif
+            case kRomFormat::Plain:
+                break;
+        }
+        return false;
+    }
+
+    /**
+     * Decompresses into a new file at path, via a temporary so a partial file never shows up under the real name
+     */
+    bool extract(const ArchiveEntry &entry, const boost::filesystem::path &path, std::string &error) {
+        auto temporary = path;
+        temporary += ".tmp" + std::to_string(::getpid());
+
+        const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            error = "couldn't create " + temporary.string() + ": " + std::strerror(errno);
+            return false;
+        }
+
+        const Sink toFile = [fd](const std::uint8_t *data, std::size_t size) {
+            while (size > 0) {
+                const auto written = ::write(fd, data, size);
+                if (written < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += written;
+                size -= written;
+            }
+            return true;
+        };
+
+        const bool ok = decompress(entry, toFile, error);
+        ::close(fd);
+
+        boost::system::error_code ec;
+        if (ok)
+            boost::filesystem::rename(temporary, path, ec);
+        if (!ok || ec) {
+            if (ec)
+                error = "couldn't move " + temporary.string() + " into place: " + ec.message();
+            boost::filesystem::remove(temporary, ec);
+            return false;
+        }
+        return true;
+    }
+
+    std::mutex cacheMutex;
+    std::map<std::string, std::weak_ptr<const RomImage>> cache;
+}
+
+RomImage::~RomImage() {
+    if (m_buffer)
+        ::munmap(m_buffer, m_bufferCapacity);
+}
+
+bool RomImage::reserve(std::size_t capacity) {
+    if (capacity <= m_bufferCapacity)
+        return true;
+
+    void *memory = m_buffer ? ::mremap(m_buffer, m_bufferCapacity, capacity, MREMAP_MAYMOVE)
+                            : ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return false;
+
+    m_buffer = static_cast<std::uint8_t *>(memory);
+    m_bufferCapacity = capacity;
+    return true;
+}
+
+bool RomImage::append(const std::uint8_t *data, std::size_t size) {
+    if (m_size + size > m_bufferCapacity &&
+        !reserve(std::max(m_size + size, std::max<std::size_t>(m_bufferCapacity * 2, kChunkSize))))
+        return false;
+
+    std::memcpy(m_buffer + m_size, data, size);
+    m_size += size;
+    return true;
+}
+
+std::shared_ptr<const RomImage> RomImage::Load(const boost::filesystem::path &path, bool needFullpath,
+                                               const boost::filesystem::path &extractDirectory, std::string &error) {
+    auto file = MappedFile::OpenShared(path);
+    if (!file) {
+        error = "couldn't open or map " + path.string();
+        return nullptr;
+    }
+
+    const auto format = detect(file->Data(), file->Size());
+    if (format == kRomFormat::Plain) {
+        auto image = std::make_shared<RomImage>();
+        image->m_path = path.string();
+        if (!needFullpath) {
+            image->m_file = file;
+            image->m_data = file->Data();
+            image->m_size = file->Size();
+        }
+        return image;
+    }
+
+    ArchiveEntry entry;
+    if (!describe(format, path, *file, entry, error))
+        return nullptr;
+
+    // Never trust a name from an archive to stay inside the extract directory
+    std::string name = boost::filesystem::path(entry.name).filename().string();
+    if (name.empty() || name == "." || name == "..")
+        name = "rom";
+
+    const auto key = entry.key + (needFullpath ? ":path" : ":data");
+    {
+        std::unique_lock<std::mutex> lk(cacheMutex);
+        if (auto image = cache[key].lock())
+            return image;
+    }
+
+    auto image = std::make_shared<RomImage>();
+    if (needFullpath) {
+        const auto directory = extractDirectory / entry.key;
+        const auto target = directory / name;
+
+        // Kept from an earlier load
+        boost::system::error_code ec;
+        if (!boost::filesystem::is_regular_file(target, ec)) {
+            boost::filesystem::create_directories(directory, ec);
+            if (!extract(entry, target, error))
+                return nullptr;
+        }
+        image->m_path = target.string();
+    } else {
+        image->m_path = path.string() + '#' + name;
+
+        if (entry.format == kRomFormat::Zip && entry.method == 0) { // Stored, use it right from the archive
+            image->m_file = file;
+            image->m_data = entry.data;
+            image->m_size = entry.size;
+        } else {
+            RomImage &target = *image;
+            if (entry.decompressedSize)
+                target.reserve(static_cast<std::size_t>(entry.decompressedSize));
+
+            const Sink toBuffer = [&target](const std::uint8_t *data, std::size_t size) {
+                return target.append(data, size);
+            };
+            if (!decompress(entry, toBuffer, error))
+                return nullptr;
+
+            image->m_data = image->m_buffer;
+        }
+    }
+
+    std::unique_lock<std::mutex> lk(cacheMutex);
+    if (auto existing = cache[key].lock()) // Someone else loaded it meanwhile
+        return existing;
+
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (it->second.expired())
+            it = cache.erase(it);
+        else
+            ++it;
+    }
+
+    cache[key] = image;
+    return image;
+}
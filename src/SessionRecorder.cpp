@@ -0,0 +1,178 @@
+#include "SessionRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+
+namespace {
+    /**
+     * File name of a segment's jpeg data or index
+     */
+    std::string segmentName(std::uint32_t segment, const char *extension) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%06u.%s", segment, extension);
+        return name;
+    }
+}
+
+SessionRecorder::~SessionRecorder() {
+    Stop();
+}
+
+bool SessionRecorder::Start(const boost::filesystem::path &directory, std::size_t segmentSize) {
+    Stop();
+
+    const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::tm utc{};
+    gmtime_r(&now, &utc);
+    char name[32];
+    std::strftime(name, sizeof(name), "%Y%m%d-%H%M%S", &utc);
+
+    // Two sessions started within the same second get a suffix
+    boost::system::error_code ec;
+    m_session = directory / name;
+    for (unsigned i = 1; boost::filesystem::exists(m_session, ec); ++i)
+        m_session = directory / (std::string(name) + '-' + std::to_string(i));
+
+    boost::filesystem::create_directories(m_session, ec);
+    if (ec)
+        return false;
+
+    m_segmentSize = segmentSize;
+    m_segment = 0;
+    m_recording = nextSegment();
+    return m_recording;
+}
+
+void SessionRecorder::Stop() {
+    m_data.Close();
+    m_index.Close();
+    m_recording = false;
+}
+
+bool SessionRecorder::nextSegment() {
+    if (m_data.IsOpen())
+        ++m_segment;
+
+    m_data.Close();
+    m_index.Close();
+
+    // Frames are rarely under 1KB, a segment of tiny frames just ends early when its index fills up
+    const std::size_t indexEntries = std::max<std::size_t>(1024, m_segmentSize / 1024);
+    return m_data.Create(m_session / segmentName(m_segment, "mjpg"), m_segmentSize) &&
+           m_index.Create(m_session / segmentName(m_segment, "idx"), indexEntries * sizeof(RecordingIndexEntry));
+}
+
+bool SessionRecorder::Append(const std::uint8_t *data, std::size_t size, std::uint64_t time) {
+    if (!m_recording || size == 0 || size > m_segmentSize)
+        return false;
+
+    const bool fits = m_data.Capacity() - m_data.Size() >= size &&
+                      m_index.Capacity() - m_index.Size() >= sizeof(RecordingIndexEntry);
+    if (!fits && !nextSegment()) {
+        Stop();
+        return false;
+    }
+
+    // Data first, so an index entry never points at a frame that isn't there yet
+    std::size_t offset;
+    m_data.Append(data, size, offset);
+
+    const RecordingIndexEntry entry{time, offset, static_cast<std::uint32_t>(size), 0};
+    std::size_t indexOffset;
+    m_index.Append(&entry, sizeof(entry), indexOffset);
+    return true;
+}
+
+bool RecordingReader::Open(const boost::filesystem::path &session) {
+    m_session = session;
+    m_frames.clear();
+    m_segments.clear();
+    m_segmentNumbers.clear();
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_directory(session, ec))
+        return false;
+
+    for (boost::filesystem::directory_iterator it(session, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto &path = it->path();
+        if (path.extension() != ".idx")
+            continue;
+
+        try {
+            m_segmentNumbers.push_back(static_cast<std::uint32_t>(std::stoul(path.stem().string())));
+        } catch (const std::exception &) {
+            continue;
+        }
+    }
+    std::sort(m_segmentNumbers.begin(), m_segmentNumbers.end());
+    m_segments.resize(m_segmentNumbers.size());
+
+    for (std::size_t s = 0; s < m_segmentNumbers.size(); ++s) {
+        MappedFile index;
+        if (!index.Open(session / segmentName(m_segmentNumbers[s], "idx")))
+            continue;
+
+        const auto *entries = reinterpret_cast<const RecordingIndexEntry *>(index.Data());
+        const std::size_t count = index.Size() / sizeof(RecordingIndexEntry);
+        for (std::size_t i = 0; i < count && entries[i].size != 0; ++i)
+            m_frames.push_back(FrameRef{entries[i].time, entries[i].offset, entries[i].size, std::uint32_t(s)});
+    }
+
+    return !m_frames.empty();
+}
+
+std::uint64_t RecordingReader::StartTime() const {
+    return m_frames.empty() ? 0 : m_frames.front().time;
+}
+
+std::uint64_t RecordingReader::EndTime() const {
+    return m_frames.empty() ? 0 : m_frames.back().time;
+}
+
+std::size_t RecordingReader::Seek(std::uint64_t time) const {
+    auto after = std::upper_bound(m_frames.begin(), m_frames.end(), time,
+                                  [](std::uint64_t t, const FrameRef &frame) { return t < frame.time; });
+    return after == m_frames.begin() ? 0 : std::distance(m_frames.begin(), after) - 1;
+}
+
+bool RecordingReader::ReadFrame(std::size_t frame, const std::uint8_t *&data, std::size_t &size) {
+    if (frame >= m_frames.size())
+        return false;
+
+    const auto &ref = m_frames[frame];
+    auto &segment = m_segments[ref.segment];
+    if (!segment.IsOpen() && !segment.Open(m_session / segmentName(m_segmentNumbers[ref.segment], "mjpg")))
+        return false;
+
+    if (ref.offset + ref.size > segment.Size())
+        return false;
+
+    data = segment.Data() + ref.offset;
+    size = ref.size;
+    return true;
+}
+
+std::size_t RecordingReader::Export(std::uint64_t from, std::uint64_t to, const boost::filesystem::path &out) {
+    if (m_frames.empty() || to < from || from > EndTime())
+        return 0;
+
+    std::ofstream file(out.string(), std::ios::binary | std::ios::trunc);
+    if (!file)
+        return 0;
+
+    std::size_t written = 0;
+    for (std::size_t i = Seek(from); i < m_frames.size() && m_frames[i].time <= to; ++i) {
+        const std::uint8_t *data;
+        std::size_t size;
+        if (!ReadFrame(i, data, size))
+            continue;
+
+        file.write(reinterpret_cast<const char *>(data), size);
+        ++written;
+    }
+
+    return file ? written : 0;
+}
@@ -0,0 +1,43 @@
+#include "SharedMessagePool.h"
+
+SharedMessagePool::SharedMessagePool(std::size_t maxPooled) : m_MaxPooled{maxPooled} {}
+
+SharedMessagePool::message_ptr SharedMessagePool::Acquire(websocketpp::frame::opcode::value op) {
+    using message_type = message_ptr::element_type;
+
+    std::unique_lock<std::mutex> lk(m_Mutex);
+
+    // use_count() == 1 means only the pool has it. Nobody else can get a new reference without going through
+    // this mutex, so it can't change underneath us.
+    for (auto &msg : m_Messages) {
+        if (msg.use_count() == 1) {
+            msg->set_prepared(false);
+            msg->set_opcode(op);
+            msg->get_raw_payload().clear();
+            return msg;
+        }
+    }
+
+    // No manager: the message is never recycled through a connection's message manager, only through here
+    auto msg = std::make_shared<message_type>(message_type::con_msg_man_ptr(), op);
+    if (m_Messages.size() < m_MaxPooled)
+        m_Messages.push_back(msg);
+
+    return msg;
+}
+
+void SharedMessagePool::Prepare(const message_ptr &msg) {
+    namespace frame = websocketpp::frame;
+
+    const auto size = msg->get_payload().size();
+    const frame::basic_header header(msg->get_opcode(), size, /* fin */ true, /* masked */ false);
+    const frame::extended_header extendedHeader(size);
+
+    msg->set_header(frame::prepare_header(header, extendedHeader));
+    msg->set_prepared(true);
+}
+
+bool SharedMessagePool::CanSendPrepared(int version) {
+    // hybi 07, 08 and 13 all share the RFC6455 framing; hixie 76 (version 0) and plain HTTP (-1) don't
+    return version >= 7;
+}
@@ -0,0 +1,192 @@
+#include "StateWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+constexpr std::size_t StateWriter::kMaxPooledBuffers;
+
+namespace {
+    /**
+     * Writes all of data to a new file at path and syncs it
+     */
+    bool writeFile(const boost::filesystem::path &path, const unsigned char *data, std::size_t size) {
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+
+        while (size > 0) {
+            const auto written = ::write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                ::close(fd);
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+
+        const bool synced = ::fsync(fd) == 0;
+        return (::close(fd) == 0) && synced;
+    }
+
+    /**
+     * Syncs a directory so renames in it survive a crash
+     */
+    void syncDirectory(const boost::filesystem::path &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+            return;
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+StateWriter::~StateWriter() {
+    Stop();
+}
+
+void StateWriter::Start(const boost::filesystem::path &historyDirectory, Logger &logger, const std::string &name) {
+    std::unique_lock<std::mutex> lk(m_Mutex);
+    if (m_Running)
+        return;
+
+    m_Directory = historyDirectory;
+    m_Logger = &logger;
+    m_Name = name;
+    m_Running = true;
+    m_Thread = std::thread([this]() { this->work(); });
+}
+
+void StateWriter::Stop() {
+    {
+        std::unique_lock<std::mutex> lk(m_Mutex);
+        m_Running = false;
+    }
+
+    m_Notifier.notify_all();
+    if (m_Thread.joinable())
+        m_Thread.join();
+}
+
+std::vector<unsigned char> StateWriter::Acquire(std::size_t size) {
+    std::vector<unsigned char> buffer;
+    {
+        std::unique_lock<std::mutex> lk(m_Mutex);
+        if (!m_Free.empty()) {
+            buffer = std::move(m_Free.back());
+            m_Free.pop_back();
+        }
+    }
+
+    buffer.resize(size);
+    return buffer;
+}
+
+void StateWriter::Save(std::vector<unsigned char> &&state, std::uint64_t maxHistorySize) {
+    {
+        std::unique_lock<std::mutex> lk(m_Mutex);
+        m_Jobs.emplace_back();
+        m_Jobs.back().state = std::move(state);
+        m_Jobs.back().maxHistorySize = maxHistorySize;
+    }
+    m_Notifier.notify_one();
+}
+
+void StateWriter::Post(std::function<void()> job) {
+    {
+        std::unique_lock<std::mutex> lk(m_Mutex);
+        m_Jobs.emplace_back();
+        m_Jobs.back().task = std::move(job);
+    }
+    m_Notifier.notify_one();
+}
+
+void StateWriter::work() {
+    std::unique_lock<std::mutex> lk(m_Mutex);
+    while (true) {
+        // Drain the queue before stopping so no state that was handed over gets lost
+        m_Notifier.wait(lk, [&]() { return !m_Running || !m_Jobs.empty(); });
+        if (m_Jobs.empty())
+            return;
+
+        Job job = std::move(m_Jobs.front());
+        m_Jobs.pop_front();
+        lk.unlock();
+
+        try {
+            if (job.task) {
+                job.task();
+            } else if (persist(job.state)) {
+                prune(job.maxHistorySize);
+            }
+        } catch (const boost::filesystem::filesystem_error &e) {
+            m_Logger->err(m_Name, ": Background save failed: ", e.what());
+        }
+
+        lk.lock();
+        if (!job.task && m_Free.size() < kMaxPooledBuffers)
+            m_Free.push_back(std::move(job.state));
+    }
+}
+
+bool StateWriter::persist(const std::vector<unsigned char> &state) {
+    const auto current = m_Directory / "current.state";
+    const auto temporary = m_Directory / "current.state.tmp";
+
+    if (!writeFile(temporary, state.data(), state.size())) {
+        m_Logger->err(m_Name, ": Failed to write ", temporary.string(), ": ", std::strerror(errno));
+        boost::system::error_code ec;
+        boost::filesystem::remove(temporary, ec);
+        return false;
+    }
+
+    if (boost::filesystem::exists(current)) { // Keep the current state in the history
+        namespace chrono = std::chrono;
+
+        auto tp = chrono::system_clock::now().time_since_epoch();
+        auto timestamp = std::to_string(chrono::duration_cast<chrono::seconds>(tp).count());
+        auto backupName = m_Directory / (timestamp + ".state");
+
+        boost::system::error_code ec;
+        boost::filesystem::remove(backupName, ec);
+        boost::filesystem::create_hard_link(current, backupName, ec);
+        if (ec) // Filesystem without hard links
+            boost::filesystem::copy_file(current, backupName);
+
+        m_Logger->log(m_Name, ": Moved current state to ", backupName.string());
+    }
+
+    boost::filesystem::rename(temporary, current);
+    syncDirectory(m_Directory);
+    return true;
+}
+
+void StateWriter::prune(std::uint64_t maxHistorySize) {
+    std::vector<boost::filesystem::path> history;
+    for (auto &p : boost::filesystem::directory_iterator(m_Directory)) {
+        auto &path = p.path();
+
+        if (boost::filesystem::is_regular_file(path) && path.extension() == ".state" &&
+            path.filename() != "current.state")
+            history.push_back(path);
+    }
+
+    if (history.size() <= maxHistorySize)
+        return;
+
+    // Timestamps all have the same length, so sorting by filename sorts by age
+    std::sort(history.begin(), history.end(), [](const auto &a, const auto &b) {
+        return a.string() < b.string();
+    });
+
+    for (std::size_t i = 0; i < history.size() - maxHistorySize; ++i) {
+        m_Logger->log(m_Name, ": Over threshold; Removing ", history[i].string());
+        boost::filesystem::remove(history[i]);
+    }
+}
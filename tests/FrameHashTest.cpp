@@ -0,0 +1,87 @@
+/**
+ * @file FrameHashTest.cpp
+ *
+ * @author ctrlaltf2
+ *
+ *  @section DESCRIPTION
+ *  Checks that FrameHash sees where things are on screen (a moved sprite changes the hash) and that every
+ *  instruction set level gives the same hash.
+ */
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "FrameHash.h"
+#include "PixelConversion.h"
+
+namespace {
+    constexpr std::uint32_t kWidth = 320, kHeight = 240, kSprite = 16;
+
+    int failures = 0;
+
+    void expect(bool condition, const char *what, const char *format, unsigned level) {
+        if (!condition) {
+            std::printf("FAIL: %s (%s, level %u)\n", what, format, level);
+            ++failures;
+        }
+    }
+
+    /**
+     * A black frame with a 16x16 sprite at (x, y). Rows are padded with garbage past the visible width.
+     */
+    std::vector<std::uint8_t> drawFrame(std::size_t bpp, std::size_t pitch, std::uint32_t x, std::uint32_t y) {
+        std::vector<std::uint8_t> pixels(pitch * kHeight, 0);
+        for (std::uint32_t row = 0; row < kHeight; ++row)
+            for (std::size_t i = kWidth * bpp; i < pitch; ++i)
+                pixels[row * pitch + i] = static_cast<std::uint8_t>(row * 31 + i);
+
+        for (std::uint32_t sy = 0; sy < kSprite; ++sy)
+            for (std::size_t sx = 0; sx < kSprite * bpp; ++sx)
+                pixels[(y + sy) * pitch + x * bpp + sx] = static_cast<std::uint8_t>(1 + sy * 13 + sx * 7);
+
+        return pixels;
+    }
+
+    std::uint64_t hashAt(retro_pixel_format format, PixelConversion::kSimdLevel level, std::uint32_t x,
+                         std::uint32_t y) {
+        const std::size_t bpp = PixelConversion::BytesPerPixel(format), pitch = kWidth * bpp + 24;
+        const auto pixels = drawFrame(bpp, pitch, x, y);
+        return FrameHash::Hash(Frame{kWidth, kHeight, static_cast<std::uint32_t>(pitch), pixels.data(), format},
+                               level);
+    }
+}
+
+int main() {
+    std::vector<PixelConversion::kSimdLevel> levels{PixelConversion::kSimdLevel::Scalar};
+    const auto detected = PixelConversion::DetectedSimdLevel();
+    if (detected >= PixelConversion::kSimdLevel::SSSE3)
+        levels.push_back(PixelConversion::kSimdLevel::SSSE3);
+    if (detected >= PixelConversion::kSimdLevel::AVX2)
+        levels.push_back(PixelConversion::kSimdLevel::AVX2);
+
+    const std::pair<retro_pixel_format, const char *> formats[] = {{RETRO_PIXEL_FORMAT_XRGB8888, "XRGB8888"},
+                                                                   {RETRO_PIXEL_FORMAT_RGB565, "RGB565"}};
+    for (const auto &format : formats) {
+        // One 32 byte hash block to the right
+        const std::uint32_t block = static_cast<std::uint32_t>(32 / PixelConversion::BytesPerPixel(format.first));
+
+        const std::uint64_t reference = hashAt(format.first, PixelConversion::kSimdLevel::Scalar, 64, 64);
+        for (const auto level : levels) {
+            const auto id = static_cast<unsigned>(level);
+            const std::uint64_t base = hashAt(format.first, level, 64, 64);
+
+            expect(base == reference, "levels give the same hash", format.second, id);
+            expect(base == hashAt(format.first, level, 64, 64), "same frame, same hash", format.second, id);
+            expect(base != hashAt(format.first, level, 64, 65), "moved down 1px", format.second, id);
+            expect(base != hashAt(format.first, level, 64, 63), "moved up 1px", format.second, id);
+            expect(base != hashAt(format.first, level, 65, 64), "moved right 1px", format.second, id);
+            expect(base != hashAt(format.first, level, 64 + block, 64), "moved right one block", format.second, id);
+            expect(base != hashAt(format.first, level, 64 + block, 65), "moved diagonally", format.second, id);
+            expect(base != hashAt(format.first, level, 64, 64 + 100), "moved down 100px", format.second, id);
+        }
+    }
+
+    if (failures == 0)
+        std::puts("FrameHash: all checks passed");
+    return failures == 0 ? 0 : 1;
+}